@@ -0,0 +1,620 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+//	ugvec_bench generates synthetic vectors in all supported input formats
+//	and measures the time of the individual stages of ugvec. Results are
+//	printed as a table and written to a JSON file, so that they can be
+//	tracked over time.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+	#include <sys/stat.h>
+	#include <unistd.h>
+#else
+	#include <direct.h>
+#endif
+
+#include "base64.h"
+#include "merge_index.h"
+#include "sharded_merge.h"
+#include "ugvec.h"
+#include "ugvec_base.h"
+
+using namespace std;
+
+///	configuration of the generated data and of the measurements
+struct BenchConfig{
+	BenchConfig() :
+		numNodes(1000000), numPieces(4), numComps(2), overlap(1), numReps(3),
+		numThreads(1), dir("ugvec_bench_data"), jsonFile("ugvec_bench.json"),
+		keepData(false)
+	{}
+
+	size_t	numNodes;
+	int		numPieces;
+	int		numComps;
+///	number of node layers which neighbouring pieces share
+	int		overlap;
+	int		numReps;
+	int		numThreads;
+	string	dir;
+	string	jsonFile;
+	bool	keepData;
+};
+
+
+///	timing of one stage
+struct StageResult{
+	string		name;
+	double		best;
+	double		mean;
+///	number of entries processed by one run
+	uint64_t	numEntries;
+///	number of bytes read or written by one run (0 if no file is involved)
+	uint64_t	numBytes;
+};
+
+
+typedef chrono::steady_clock	Clock;
+
+static double SecondsSince(const Clock::time_point& start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+static uint64_t FileSize(const string& filename)
+{
+	ifstream in(filename.c_str(), ios::binary | ios::ate);
+	return in ? (uint64_t)in.tellg() : 0;
+}
+
+
+///	runs 'run' numReps times. 'run' performs its setup and returns the seconds of the timed part.
+template <class TRun>
+static StageResult
+TimeStage(const char* name, int numReps, uint64_t numEntries, uint64_t numBytes, TRun run)
+{
+	StageResult res;
+	res.name = name;
+	res.best = 0;
+	res.mean = 0;
+	res.numEntries = numEntries;
+	res.numBytes = numBytes;
+
+	for(int i = 0; i < numReps; ++i){
+		const double t = run();
+		res.best = (i == 0) ? t : min(res.best, t);
+		res.mean += t / numReps;
+	}
+	return res;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//	data generation
+
+///	value of component ci at the given position
+static number SampleValue(const Node& n, int ci, uint64_t& rng)
+{
+//	smooth part plus some deterministic noise, so that histograms are not trivial
+	rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+	const number noise = (number)(rng >> 11) / (number)(uint64_t(1) << 53) - 0.5;
+	return sin(6.283185307179586 * (n.x + 0.25 * ci)) * cos(6.283185307179586 * n.y)
+		   + (ci + 1) * n.z * n.z + 0.01 * noise;
+}
+
+
+///	creates a vector on the x-layers [xBegin, xEnd) of a regular grid with n^3 nodes
+/**	Values of nodes which are contained in numShared(x) pieces are divided
+ * by that number, so that adding the pieces (additive storage) results in
+ * the serial vector.*/
+static void CreateGridVector(AlgebraicVector& av, size_t n, int numComps,
+							 size_t xBegin, size_t xEnd,
+							 const vector<int>& numShared)
+{
+	av.clear();
+	av.worldDim = 3;
+
+	const number h = 1. / (number)max<size_t>(n - 1, 1);
+	const size_t numNodes = (xEnd - xBegin) * n * n;
+	av.nodes.resize(numNodes);
+	Node* nodes = av.nodes.data();
+
+	size_t i = 0;
+	for(size_t x = xBegin; x < xEnd; ++x){
+		for(size_t y = 0; y < n; ++y){
+			for(size_t z = 0; z < n; ++z, ++i){
+				nodes[i].x = h * x;
+				nodes[i].y = h * y;
+				nodes[i].z = h * z;
+			}
+		}
+	}
+
+	vector<uint> compNodes(numNodes);
+	for(size_t i = 0; i < numNodes; ++i)
+		compNodes[i] = (uint)i;
+
+	av.comps.resize(numComps);
+	for(int ci = 0; ci < numComps; ++ci){
+		Component& comp = av.comps[ci];
+		comp.nodes = compNodes;
+		comp.data.resize(numNodes);
+		number* data = comp.data.data();
+	//	the noise depends on the node only, so that pieces match the serial vector
+		for(size_t i = 0; i < numNodes; ++i){
+			uint64_t rng = ((xBegin * n * n + i) * numComps + ci) * 0x9E3779B97F4A7C15ULL;
+			data[i] = SampleValue(nodes[i], ci, rng) / numShared[xBegin + i / (n * n)];
+		}
+	}
+}
+
+
+///	appends a DataArray with 'numTuples' tuples of 'numComps' values read through 'get'
+template <class TGet>
+static void WriteDataArray(ostream& out, const char* name, size_t numTuples,
+						   int numComps, bool binary, TGet get)
+{
+	out << "<DataArray type=\"Float64\" Name=\"" << name << "\" NumberOfComponents=\""
+		<< numComps << "\" format=\"" << (binary ? "binary" : "ascii") << "\">";
+
+	if(binary){
+	//	header (number of data bytes) and data are encoded as a single base64 stream
+		const uint64_t numBytes = numTuples * numComps * sizeof(double);
+		vector<unsigned char> buf(sizeof(uint64_t) + numBytes);
+		memcpy(&buf.front(), &numBytes, sizeof(uint64_t));
+		double* vals = (double*)(&buf.front() + sizeof(uint64_t));
+		for(size_t i = 0; i < numTuples; ++i){
+			for(int ic = 0; ic < numComps; ++ic)
+				vals[i * numComps + ic] = get(i, ic);
+		}
+		out << base64_encode(&buf.front(), buf.size());
+	}
+	else{
+		out << setprecision(17);
+		for(size_t i = 0; i < numTuples; ++i){
+			for(int ic = 0; ic < numComps; ++ic)
+				out << get(i, ic) << ' ';
+			out << '\n';
+		}
+	}
+	out << "</DataArray>";
+}
+
+
+static bool BigEndianHost()
+{
+	const uint16_t val = 1;
+	return *(const unsigned char*)&val == 0;
+}
+
+
+///	writes a vector whose components are defined on all nodes (in node order) to a vtu file
+static bool WriteVTU(const AlgebraicVector& av, const string& filename, bool binary)
+{
+	ofstream out(filename.c_str(), ios::binary);
+	if(!out)
+		return false;
+
+	const size_t numNodes = av.nodes.size();
+	out << "<?xml version=\"1.0\"?>\n"
+		<< "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\""
+		<< (BigEndianHost() ? "BigEndian" : "LittleEndian") << "\" header_type=\"UInt64\">"
+		<< "<UnstructuredGrid><Piece NumberOfPoints=\"" << numNodes << "\" NumberOfCells=\"0\">"
+		<< "<Points>";
+	WriteDataArray(out, "pts", numNodes, 3, binary,
+		[&](size_t i, int ic){return av.nodes[i].coord[ic];});
+	out << "</Points><PointData>";
+	for(int ci = 0; ci < av.num_components(); ++ci){
+		ostringstream name;
+		name << "c" << ci;
+		const Component& comp = av.comps[ci];
+		WriteDataArray(out, name.str().c_str(), numNodes, 1, binary,
+			[&](size_t i, int){return comp.data[i];});
+	}
+	out << "</PointData></Piece></UnstructuredGrid></VTKFile>\n";
+	return (bool)out;
+}
+
+
+///	writes the header file of a parallel vector (pvec or pvtu) referencing the given pieces
+static bool WriteParallelHeader(const string& filename, const vector<string>& pieces, bool vtu)
+{
+	ofstream out(filename.c_str());
+	if(!out)
+		return false;
+	if(vtu){
+		out << "<?xml version=\"1.0\"?>\n"
+			<< "<VTKFile type=\"PUnstructuredGrid\" version=\"1.0\"><PUnstructuredGrid>";
+		for(size_t i = 0; i < pieces.size(); ++i)
+			out << "<Piece Source=\"" << pieces[i] << "\"/>";
+		out << "</PUnstructuredGrid></VTKFile>\n";
+	}
+	else{
+		out << pieces.size() << "\n";
+		for(size_t i = 0; i < pieces.size(); ++i)
+			out << pieces[i] << "\n";
+	}
+	return (bool)out;
+}
+
+
+///	names of the generated files relative to BenchConfig::dir
+struct BenchFiles{
+	string			vec;
+	string			vtuAscii;
+	string			vtuBinary;
+	string			pvec;
+	string			pvtu;
+	vector<string>	all;
+};
+
+
+///	generates all data sets and returns the pieces of the parallel vector in 'piecesOut'
+static bool GenerateData(BenchFiles& files, vector<AlgebraicVector>& piecesOut,
+						 const BenchConfig& cfg)
+{
+	const string dir = cfg.dir + "/";
+	const size_t n = max<size_t>(2, (size_t)round(cbrt((double)cfg.numNodes)));
+	const size_t numPieces = (size_t)max(1, min<int>(cfg.numPieces, (int)n));
+	const size_t overlap = (size_t)max(0, cfg.overlap);
+
+//	piece p consists of the x-layers [begin[p], end[p])
+	vector<size_t> begin(numPieces), end(numPieces);
+	vector<int> numShared(n, 0);
+	for(size_t p = 0; p < numPieces; ++p){
+		begin[p] = p * n / numPieces;
+		end[p] = min(n, (p + 1) * n / numPieces + (p + 1 < numPieces ? overlap : 0));
+		for(size_t x = begin[p]; x < end[p]; ++x)
+			++numShared[x];
+	}
+
+	vector<int> notShared(n, 1);
+	AlgebraicVector serial;
+	CreateGridVector(serial, n, cfg.numComps, 0, n, notShared);
+
+	files.vec = dir + "serial.vec";
+	files.vtuAscii = dir + "serial_ascii.vtu";
+	files.vtuBinary = dir + "serial_binary.vtu";
+	files.pvec = dir + "parallel.pvec";
+	files.pvtu = dir + "parallel.pvtu";
+
+	if(!Save_VEC(serial, files.vec.c_str())
+	   || !WriteVTU(serial, files.vtuAscii, false)
+	   || !WriteVTU(serial, files.vtuBinary, true))
+	{
+		return false;
+	}
+
+	vector<string> vecPieces, vtuPieces;
+	piecesOut.resize(numPieces);
+	for(size_t p = 0; p < numPieces; ++p){
+		CreateGridVector(piecesOut[p], n, cfg.numComps, begin[p], end[p], numShared);
+
+		char name[64];
+		snprintf(name, sizeof(name), "parallel_p%04d", (int)p);
+		vecPieces.push_back(string(name) + ".vec");
+		vtuPieces.push_back(string(name) + ".vtu");
+		if(!Save_VEC(piecesOut[p], (dir + vecPieces.back()).c_str())
+		   || !WriteVTU(piecesOut[p], dir + vtuPieces.back(), true))
+		{
+			return false;
+		}
+	}
+
+	if(!WriteParallelHeader(files.pvec, vecPieces, false)
+	   || !WriteParallelHeader(files.pvtu, vtuPieces, true))
+	{
+		return false;
+	}
+
+	files.all.push_back(files.vec);
+	files.all.push_back(files.vtuAscii);
+	files.all.push_back(files.vtuBinary);
+	files.all.push_back(files.pvec);
+	files.all.push_back(files.pvtu);
+	for(size_t p = 0; p < numPieces; ++p){
+		files.all.push_back(dir + vecPieces[p]);
+		files.all.push_back(dir + vtuPieces[p]);
+	}
+	return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//	reporting
+
+static void WriteJSON(ostream& out, const BenchConfig& cfg, size_t numNodes,
+					  size_t numPieces, const vector<StageResult>& results)
+{
+	out << setprecision(9);
+	out << "{\n"
+		<< "  \"benchmark\": \"ugvec_bench\",\n"
+		<< "  \"version\": 1,\n"
+		<< "  \"config\": {\"nodes\": " << numNodes
+		<< ", \"pieces\": " << numPieces
+		<< ", \"components\": " << cfg.numComps
+		<< ", \"overlap\": " << cfg.overlap
+		<< ", \"threads\": " << NumThreads()
+		<< ", \"repetitions\": " << cfg.numReps << "},\n"
+		<< "  \"results\": [\n";
+
+	for(size_t i = 0; i < results.size(); ++i){
+		const StageResult& r = results[i];
+		out << "    {\"stage\": \"" << r.name << "\""
+			<< ", \"seconds_best\": " << r.best
+			<< ", \"seconds_mean\": " << r.mean
+			<< ", \"entries\": " << r.numEntries
+			<< ", \"bytes\": " << r.numBytes
+			<< ", \"entries_per_second\": " << (r.best > 0 ? r.numEntries / r.best : 0)
+			<< ", \"megabytes_per_second\": " << (r.best > 0 ? r.numBytes / r.best * 1e-6 : 0)
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+
+static void PrintResults(const vector<StageResult>& results)
+{
+	cout << endl
+		 << left << setw(18) << "stage"
+		 << right << setw(12) << "best [s]"
+		 << setw(12) << "mean [s]"
+		 << setw(14) << "Mentries/s"
+		 << setw(10) << "MB/s" << endl;
+
+	for(size_t i = 0; i < results.size(); ++i){
+		const StageResult& r = results[i];
+		cout << left << setw(18) << r.name << right << fixed << setprecision(4)
+			 << setw(12) << r.best
+			 << setw(12) << r.mean
+			 << setprecision(2)
+			 << setw(14) << (r.best > 0 ? r.numEntries / r.best * 1e-6 : 0);
+		if(r.numBytes > 0)
+			cout << setw(10) << (r.best > 0 ? r.numBytes / r.best * 1e-6 : 0);
+		cout << endl;
+	}
+	cout.unsetf(ios::floatfield);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//	main
+
+static bool ReadIntArg(int argc, char** argv, int& i, long& valOut)
+{
+	if(i + 1 >= argc){
+		cout << "Invalid use of '" << argv[i] << "': An integer value has to be supplied." << endl;
+		return false;
+	}
+	valOut = atol(argv[++i]);
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	BenchConfig cfg;
+
+	for(int i = 1; i < argc; ++i){
+		long val = 0;
+		const string arg = argv[i];
+		if(arg == "-nodes" || arg == "-pieces" || arg == "-comps"
+		   || arg == "-overlap" || arg == "-reps" || arg == "-threads")
+		{
+			if(!ReadIntArg(argc, argv, i, val))
+				return 1;
+			if(arg == "-nodes")			cfg.numNodes = (size_t)max(8L, val);
+			else if(arg == "-pieces")	cfg.numPieces = (int)max(1L, val);
+			else if(arg == "-comps")	cfg.numComps = (int)max(1L, val);
+			else if(arg == "-overlap")	cfg.overlap = (int)max(0L, val);
+			else if(arg == "-reps")		cfg.numReps = (int)max(1L, val);
+			else						cfg.numThreads = (int)val;
+		}
+		else if(arg == "-dir" && i + 1 < argc)
+			cfg.dir = argv[++i];
+		else if(arg == "-json" && i + 1 < argc)
+			cfg.jsonFile = argv[++i];
+		else if(arg == "-keep")
+			cfg.keepData = true;
+		else{
+			cout << "USAGE: ugvec_bench [-nodes n] [-pieces n] [-comps n] [-overlap n]" << endl
+				 << "                   [-reps n] [-threads n] [-dir path] [-json file] [-keep]" << endl << endl
+				 << "  -nodes n:    approximate number of nodes of the generated grid (default 1000000)" << endl
+				 << "  -pieces n:   number of pieces of the parallel vectors (default 4)" << endl
+				 << "  -comps n:    number of components (default 2)" << endl
+				 << "  -overlap n:  number of node layers shared by neighbouring pieces (default 1)" << endl
+				 << "  -reps n:     number of runs of each stage. The best time is reported (default 3)" << endl
+				 << "  -threads n:  number of threads, 0 for all hardware threads (default 1)" << endl
+				 << "  -dir path:   directory for the generated data (default ugvec_bench_data)" << endl
+				 << "  -json file:  file to which the results are written (default ugvec_bench.json)" << endl
+				 << "  -keep:       keeps the generated data" << endl;
+			return arg == "-help" ? 0 : 1;
+		}
+	}
+
+	SetNumThreads(cfg.numThreads);
+
+	#ifndef _WIN32
+		mkdir(cfg.dir.c_str(), 0755);
+	#else
+		_mkdir(cfg.dir.c_str());
+	#endif
+
+	try{
+		cout << "generating data in " << cfg.dir << endl;
+		BenchFiles files;
+		vector<AlgebraicVector> pieces;
+		CHECK(GenerateData(files, pieces, cfg), "Couldn't write data to " << cfg.dir);
+
+		AlgebraicVector serial;
+		CHECK(Load_VEC(serial, files.vec.c_str()), "Couldn't load " << files.vec);
+		const size_t numNodes = serial.nodes.size();
+		const uint64_t numEntries = serial.num_entries();
+
+		uint64_t numPieceEntries = 0;
+		for(size_t i = 0; i < pieces.size(); ++i)
+			numPieceEntries += pieces[i].num_entries();
+
+		vector<StageResult> results;
+		const int reps = cfg.numReps;
+
+		results.push_back(TimeStage("Load_VEC", reps, numEntries, FileSize(files.vec),
+			[&](){
+				AlgebraicVector av;
+				const Clock::time_point start = Clock::now();
+				CHECK(Load_VEC(av, files.vec.c_str()), "Couldn't load " << files.vec);
+				return SecondsSince(start);
+			}));
+
+		results.push_back(TimeStage("Load_VTU_ascii", reps, numEntries, FileSize(files.vtuAscii),
+			[&](){
+				AlgebraicVector av;
+				const Clock::time_point start = Clock::now();
+				CHECK(Load_VTU(av, files.vtuAscii.c_str()), "Couldn't load " << files.vtuAscii);
+				return SecondsSince(start);
+			}));
+
+		results.push_back(TimeStage("Load_VTU_binary", reps, numEntries, FileSize(files.vtuBinary),
+			[&](){
+				AlgebraicVector av;
+				const Clock::time_point start = Clock::now();
+				CHECK(Load_VTU(av, files.vtuBinary.c_str()), "Couldn't load " << files.vtuBinary);
+				return SecondsSince(start);
+			}));
+
+	//	the sizes of parallel files include their pieces
+		uint64_t pvecBytes = 0, pvtuBytes = 0;
+		for(size_t i = 0; i < files.all.size(); ++i){
+			const string& f = files.all[i];
+			if(f.compare(0, cfg.dir.size() + 10, cfg.dir + "/parallel_") == 0){
+				if(f.rfind(".vec") == f.size() - 4)
+					pvecBytes += FileSize(f);
+				else
+					pvtuBytes += FileSize(f);
+			}
+		}
+
+		AlgebraicVector parallel;
+		results.push_back(TimeStage("Load_PVEC", reps, numPieceEntries, pvecBytes,
+			[&](){
+				AlgebraicVector av;
+				const Clock::time_point start = Clock::now();
+				CHECK(Load_PVEC(av, files.pvec.c_str(), true), "Couldn't load " << files.pvec);
+				const double t = SecondsSince(start);
+				parallel.swap(av);
+				return t;
+			}));
+
+		results.push_back(TimeStage("Load_PVTU", reps, numPieceEntries, pvtuBytes,
+			[&](){
+				AlgebraicVector av;
+				const Clock::time_point start = Clock::now();
+				CHECK(Load_PVTU(av, files.pvtu.c_str(), true), "Couldn't load " << files.pvtu);
+				return SecondsSince(start);
+			}));
+
+	//	merges pieces which are already in memory in the same way as LoadPieces
+		results.push_back(TimeStage("piece_merge", reps, numPieceEntries, 0,
+			[&](){
+				AlgebraicVector av;
+				if(NumThreads() > 1 && pieces.size() > 1){
+					ShardedMerge merger(NumThreads(), true);
+					vector<ShardedPiece> sp(pieces.size());
+					for(size_t i = 0; i < pieces.size(); ++i)
+						sp[i].av = pieces[i];
+
+					const Clock::time_point start = Clock::now();
+					ParallelFor(sp.size(), NumThreads(),
+						[&](size_t i){merger.prepare(sp[i]);});
+					for(size_t i = 0; i < sp.size(); ++i)
+						merger.merge(sp[i]);
+					merger.assemble(av);
+					return SecondsSince(start);
+				}
+
+				const Clock::time_point start = Clock::now();
+				MergeIndex globIndex;
+				globIndex.init(av);
+				for(size_t i = 0; i < pieces.size(); ++i)
+					av.add_vector(pieces[i], globIndex);
+				return SecondsSince(start);
+			}));
+
+	//	the merged parallel vector has the nodes of the serial one in a different order
+		results.push_back(TimeStage("subtract_vector", reps, numEntries, 0,
+			[&](){
+				AlgebraicVector av(serial);
+				const Clock::time_point start = Clock::now();
+				av.subtract_vector(parallel);
+				return SecondsSince(start);
+			}));
+
+		results.push_back(TimeStage("ComputeStatistics", reps, numEntries, 0,
+			[&](){
+				vector<ComponentStatistics> stats;
+				const Clock::time_point start = Clock::now();
+				ComputeStatistics(stats, serial);
+				return SecondsSince(start);
+			}));
+
+		results.push_back(TimeStage("CreateHistogram", reps, numEntries, 0,
+			[&](){
+				vector<int> hist;
+				ostringstream histLog;
+				const Clock::time_point start = Clock::now();
+				CreateHistogram(hist, serial, 10, false, false, NULL, histLog);
+				return SecondsSince(start);
+			}));
+
+		const string outFile = cfg.dir + "/out.vec";
+		files.all.push_back(outFile);
+		results.push_back(TimeStage("Save_VEC", reps, numEntries, 0,
+			[&](){
+				const Clock::time_point start = Clock::now();
+				CHECK(Save_VEC(serial, outFile.c_str()), "Couldn't write " << outFile);
+				return SecondsSince(start);
+			}));
+		results.back().numBytes = FileSize(outFile);
+
+		PrintResults(results);
+
+		ofstream json(cfg.jsonFile.c_str());
+		CHECK(json, "Couldn't write " << cfg.jsonFile);
+		WriteJSON(json, cfg, numNodes, pieces.size(), results);
+		cout << "results written to " << cfg.jsonFile << endl;
+
+		if(!cfg.keepData){
+			for(size_t i = 0; i < files.all.size(); ++i)
+				remove(files.all[i].c_str());
+			#ifndef _WIN32
+				rmdir(cfg.dir.c_str());
+			#else
+				_rmdir(cfg.dir.c_str());
+			#endif
+		}
+	}
+	catch(...){
+		return 1;
+	}
+	return 0;
+}
@@ -8,8 +8,20 @@
 
 // 2016-12-12 - Gaspard Petit : Slightly modified to return a std::string 
 // instead of a buffer allocated with malloc.
+// Added base64_decoded_size and Base64Decoder, which decode into caller
+// provided buffers and support concatenated encodings.
+// Added AVX2 and SSE4.1 decoding of contiguous runs of base64 characters,
+// selected at runtime depending on the CPU.
 
 #include <string>
+#include <string.h>
+
+#include "base64.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define BASE64_X86_SIMD 1
+	#include <immintrin.h>
+#endif
 
 static const unsigned int base64_table[64] ={
 	'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
@@ -151,3 +163,340 @@ std::string base64_decode(const unsigned char *src, size_t len)
 	outStr.resize(pos - out);
 	return outStr;
 }
+
+
+#ifdef BASE64_X86_SIMD
+
+/*
+* The vectorized routines below process groups of 16 (SSE4.1) or 32 (AVX2)
+* characters. A group is only handled if all of its characters belong to
+* the alphabet accepted by dtable (including the URL-safe '-' and '_') and
+* none of them is '='. All other groups are left to the scalar code, which
+* skips invalid characters and handles padding. Both paths therefore
+* produce identical results.
+*/
+
+/* Translates 16 characters to their 6-bit values. Returns 0xFFFF in
+* validMask if all characters are valid.*/
+__attribute__((target("sse4.1")))
+static inline __m128i sse_translate(__m128i c, int *validMask)
+{
+	const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+										_mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+										_mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+	const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+										_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	const __m128i plus = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')),
+									  _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+	const __m128i slash = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')),
+									   _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+
+	const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+									   _mm_or_si128(_mm_or_si128(digit, plus), slash));
+	*validMask = _mm_movemask_epi8(valid);
+
+	__m128i v = _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A')));
+	v = _mm_or_si128(v, _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 26))));
+	v = _mm_or_si128(v, _mm_and_si128(digit, _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))));
+	v = _mm_or_si128(v, _mm_and_si128(plus, _mm_set1_epi8(62)));
+	v = _mm_or_si128(v, _mm_and_si128(slash, _mm_set1_epi8(63)));
+	return v;
+}
+
+/* Packs 16 6-bit values to 12 bytes (in the lowest 12 bytes of the result).*/
+__attribute__((target("sse4.1")))
+static inline __m128i sse_pack(__m128i v)
+{
+	// 2 values to 12 bits in 16-bit words, then 2 words to 24 bits in 32-bit words
+	const __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140)),
+										  _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+												  14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("sse4.1")))
+static size_t decode_groups_sse41(const unsigned char *src, size_t len,
+								  unsigned char *out, size_t outLen)
+{
+	size_t i = 0;
+	while (len - i >= 16 && outLen >= 16) {
+		int validMask;
+		const __m128i v = sse_translate(_mm_loadu_si128((const __m128i*)(src + i)),
+										&validMask);
+		if (validMask != 0xFFFF)
+			break;
+		_mm_storeu_si128((__m128i*)out, sse_pack(v));
+		i += 16;
+		out += 12;
+		outLen -= 12;
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t count_groups_sse41(const unsigned char *src, size_t len)
+{
+	size_t i = 0;
+	while (len - i >= 16) {
+		int validMask;
+		sse_translate(_mm_loadu_si128((const __m128i*)(src + i)), &validMask);
+		if (validMask != 0xFFFF)
+			break;
+		i += 16;
+	}
+	return i;
+}
+
+
+/* AVX2 version of sse_translate for 32 characters.*/
+__attribute__((target("avx2")))
+static inline __m256i avx2_translate(__m256i c, unsigned int *validMask)
+{
+	const __m256i upper = _mm256_andnot_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('Z')),
+											  _mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)));
+	const __m256i lower = _mm256_andnot_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('z')),
+											  _mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)));
+	const __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('9')),
+											  _mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)));
+	const __m256i plus = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('+')),
+										 _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')));
+	const __m256i slash = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/')),
+										  _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+
+	const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+										  _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+	*validMask = (unsigned int)_mm256_movemask_epi8(valid);
+
+	__m256i v = _mm256_and_si256(upper, _mm256_sub_epi8(c, _mm256_set1_epi8('A')));
+	v = _mm256_or_si256(v, _mm256_and_si256(lower, _mm256_sub_epi8(c, _mm256_set1_epi8('a' - 26))));
+	v = _mm256_or_si256(v, _mm256_and_si256(digit, _mm256_add_epi8(c, _mm256_set1_epi8(52 - '0'))));
+	v = _mm256_or_si256(v, _mm256_and_si256(plus, _mm256_set1_epi8(62)));
+	v = _mm256_or_si256(v, _mm256_and_si256(slash, _mm256_set1_epi8(63)));
+	return v;
+}
+
+__attribute__((target("avx2")))
+static size_t decode_groups_avx2(const unsigned char *src, size_t len,
+								 unsigned char *out, size_t outLen)
+{
+	size_t i = 0;
+	while (len - i >= 32 && outLen >= 32) {
+		unsigned int validMask;
+		const __m256i v = avx2_translate(_mm256_loadu_si256((const __m256i*)(src + i)),
+										 &validMask);
+		if (validMask != 0xFFFFFFFFu)
+			break;
+
+		const __m256i merged = _mm256_madd_epi16(
+									_mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140)),
+									_mm256_set1_epi32(0x00011000));
+		// 12 bytes at the start of each 128-bit lane, which are then moved together
+		const __m256i shuffled = _mm256_shuffle_epi8(merged,
+									_mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+													 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm256_storeu_si256((__m256i*)out,
+			_mm256_permutevar8x32_epi32(shuffled, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)));
+		i += 32;
+		out += 24;
+		outLen -= 24;
+	}
+	return i + decode_groups_sse41(src + i, len - i, out, outLen);
+}
+
+__attribute__((target("avx2")))
+static size_t count_groups_avx2(const unsigned char *src, size_t len)
+{
+	size_t i = 0;
+	while (len - i >= 32) {
+		unsigned int validMask;
+		avx2_translate(_mm256_loadu_si256((const __m256i*)(src + i)), &validMask);
+		if (validMask != 0xFFFFFFFFu)
+			break;
+		i += 32;
+	}
+	return i + count_groups_sse41(src + i, len - i);
+}
+
+#endif	// BASE64_X86_SIMD
+
+
+/* decodes leading groups of valid characters. Returns the number of consumed
+* characters (a multiple of 4). 3/4 of that number of bytes are written to out.*/
+typedef size_t (*DecodeGroupsFunc)(const unsigned char *src, size_t len,
+								   unsigned char *out, size_t outLen);
+
+/* returns the number of leading characters in groups of valid characters.*/
+typedef size_t (*CountGroupsFunc)(const unsigned char *src, size_t len);
+
+struct SimdFuncs {
+	const char *name;
+	DecodeGroupsFunc decode;
+	CountGroupsFunc count;
+};
+
+/* functions of each Base64SimdLevel*/
+static const SimdFuncs simd_funcs_of_level[] = {
+	{"none", NULL, NULL},
+#ifdef BASE64_X86_SIMD
+	{"sse4.1", &decode_groups_sse41, &count_groups_sse41},
+	{"avx2", &decode_groups_avx2, &count_groups_avx2}
+#endif
+};
+
+static Base64SimdLevel supported_simd_level()
+{
+#ifdef BASE64_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return BASE64_SIMD_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return BASE64_SIMD_SSE41;
+#endif
+	return BASE64_SIMD_NONE;
+}
+
+static const Base64SimdLevel max_simd_level = supported_simd_level();
+static const SimdFuncs *simd_funcs = &simd_funcs_of_level[max_simd_level];
+
+
+Base64SimdLevel base64_set_simd_level(Base64SimdLevel level)
+{
+	if (level > max_simd_level)
+		level = max_simd_level;
+	if (level < BASE64_SIMD_NONE)
+		level = BASE64_SIMD_NONE;
+	simd_funcs = &simd_funcs_of_level[level];
+	return level;
+}
+
+
+void base64_set_simd_enabled(bool enable)
+{
+	base64_set_simd_level(enable ? BASE64_SIMD_AVX2 : BASE64_SIMD_NONE);
+}
+
+
+const char* base64_simd_instruction_set()
+{
+	return simd_funcs->name;
+}
+
+
+// The following functions decode into caller provided buffers instead of
+// returning a std::string, so that data can be converted while it is decoded.
+
+size_t base64_decoded_size(const unsigned char *src, size_t len)
+{
+	const CountGroupsFunc countGroups = simd_funcs->count;
+	size_t numBytes = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (countGroups && i % 16 == 0) {
+			const size_t n = countGroups(src + i, len - i);
+			i += n;
+			count += n;
+			if (i == len)
+				break;
+		}
+
+		if (src[i] == '=') {
+			numBytes += count * 6 / 8;
+			count = 0;
+		}
+		else if (dtable[src[i]] != 0x80)
+			count++;
+	}
+	return numBytes + count * 6 / 8;
+}
+
+
+Base64Decoder::Base64Decoder(const unsigned char *src, size_t len) :
+	m_src(src),
+	m_end(src + len),
+	m_numPending(0),
+	m_firstPending(0)
+{
+}
+
+
+size_t Base64Decoder::decode(unsigned char *out, size_t maxLen)
+{
+	unsigned char *pos = out;
+	unsigned char *end = out + maxLen;
+	unsigned char block[4] = {0, 0, 0, 0};
+	size_t count = 0;
+
+	// bytes of the last block which did not fit into the previous buffer
+	while (m_numPending > 0 && pos < end) {
+		*pos++ = m_pending[m_firstPending++];
+		m_numPending--;
+	}
+
+	const DecodeGroupsFunc decodeGroups = simd_funcs->decode;
+
+	while (pos < end && m_src < m_end) {
+		if (decodeGroups && count == 0) {
+			const size_t n = decodeGroups(m_src, m_end - m_src, pos, end - pos);
+			m_src += n;
+			pos += n / 4 * 3;
+			if (pos == end || m_src == m_end)
+				break;
+		}
+
+		unsigned char c = *m_src++;
+		unsigned char tmp = dtable[c];
+		if (tmp == 0x80 || c == '=') {
+			if (c == '=' && count > 0) {
+				// end of a block. Emit the complete bytes of the partial quantum.
+				unsigned char decoded[3] = {0, 0, 0};
+				decoded[0] = (block[0] << 2) | (count > 1 ? block[1] >> 4 : 0);
+				decoded[1] = (block[1] << 4) | (count > 2 ? block[2] >> 2 : 0);
+				const size_t num = count * 6 / 8;
+				count = 0;
+				for (size_t i = 0; i < num; ++i) {
+					if (pos < end)
+						*pos++ = decoded[i];
+					else {
+						m_pending[m_numPending++] = decoded[i];
+						m_firstPending = 0;
+					}
+				}
+			}
+			continue;
+		}
+
+		block[count++] = tmp;
+		if (count == 4) {
+			unsigned char decoded[3] = {0, 0, 0};
+			decoded[0] = (block[0] << 2) | (block[1] >> 4);
+			decoded[1] = (block[1] << 4) | (block[2] >> 2);
+			decoded[2] = (block[2] << 6) | block[3];
+			count = 0;
+			m_firstPending = 0;
+			for (size_t i = 0; i < 3; ++i) {
+				if (pos < end)
+					*pos++ = decoded[i];
+				else
+					m_pending[m_numPending++] = decoded[i];
+			}
+		}
+	}
+
+	// a trailing partial quantum without padding
+	if (count > 0) {
+		unsigned char decoded[3] = {0, 0, 0};
+		decoded[0] = (block[0] << 2) | (count > 1 ? block[1] >> 4 : 0);
+		decoded[1] = (block[1] << 4) | (count > 2 ? block[2] >> 2 : 0);
+		const size_t num = count * 6 / 8;
+		m_firstPending = 0;
+		for (size_t i = 0; i < num; ++i) {
+			if (pos < end)
+				*pos++ = decoded[i];
+			else
+				m_pending[m_numPending++] = decoded[i];
+		}
+	}
+
+	return pos - out;
+}
@@ -13,4 +13,61 @@
 std::string base64_encode(const unsigned char *src, size_t len);
 std::string base64_decode(const unsigned char *src, size_t len);
 
+/**
+* base64_decoded_size - Returns the number of bytes encoded in src.
+* Characters outside of the base64 alphabet are ignored. '=' terminates
+* a block, after which a new block may follow (concatenated encodings).
+*/
+size_t base64_decoded_size(const unsigned char *src, size_t len);
+
+/**
+* Base64Decoder - Decodes base64 data piece by piece into caller provided
+* buffers. Handles the same input as base64_decoded_size.
+*/
+class Base64Decoder {
+public:
+	Base64Decoder(const unsigned char *src, size_t len);
+
+	/** Decodes up to maxLen bytes to out. Returns the number of written
+	 * bytes, which is smaller than maxLen only at the end of the input.*/
+	size_t decode(unsigned char *out, size_t maxLen);
+
+private:
+	const unsigned char *m_src;
+	const unsigned char *m_end;
+	unsigned char m_pending[3];
+	size_t m_numPending;
+	size_t m_firstPending;
+};
+
+/**
+* Base64SimdLevel - Instruction sets of the vectorized decoding paths
+*/
+enum Base64SimdLevel {
+	BASE64_SIMD_NONE = 0,
+	BASE64_SIMD_SSE41 = 1,
+	BASE64_SIMD_AVX2 = 2
+};
+
+/**
+* base64_set_simd_level - Selects the instruction set of the vectorized
+* decoding paths of base64_decoded_size and Base64Decoder. By default, the
+* best one supported by the CPU is used. If the CPU doesn't support 'level',
+* the best supported level below it is used. Returns the selected level.
+* All levels produce the same results as the scalar code.
+*/
+Base64SimdLevel base64_set_simd_level(Base64SimdLevel level);
+
+/**
+* base64_set_simd_enabled - Enables the best supported or disables all
+* vectorized decoding paths (see base64_set_simd_level).
+*/
+void base64_set_simd_enabled(bool enable);
+
+/**
+* base64_simd_instruction_set - Returns the name of the instruction set used
+* for decoding ("avx2", "sse4.1" or "none").
+*/
+const char* base64_simd_instruction_set();
+
 #endif	//__H__base64
@@ -15,11 +15,92 @@
 #include <sstream>
 #include <cstring>
 #include <map>
+#include <memory>
+#include <stdint.h>
 
 #include "algebraic_vector.h"
+#include "merge_index.h"
+#include "ugvec_base.h"
 
 using namespace std;
 
+////////////////////////////////////////////////////////////////////////////////
+//	canonical order
+
+///	maps the bits of a coordinate to an unsigned integer with the same order as the coordinate
+static inline uint64_t OrderedBits(number c)
+{
+	const uint64_t bits = CoordinateBits(c);
+	const uint64_t signBit = uint64_t(1) << 63;
+	return (bits & signBit) ? ~bits : (bits | signBit);
+}
+
+///	spreads the lower 21 bits of v, so that two zero bits follow each bit
+static inline uint64_t SpreadBits21(uint64_t v)
+{
+	v &= 0x1FFFFF;
+	v = (v | (v << 32)) & 0x001F00000000FFFFULL;
+	v = (v | (v << 16)) & 0x001F0000FF0000FFULL;
+	v = (v | (v << 8))  & 0x100F00F00F00F00FULL;
+	v = (v | (v << 4))  & 0x10C30C30C30C30C3ULL;
+	v = (v | (v << 2))  & 0x1249249249249249ULL;
+	return v;
+}
+
+///	Z-order key built from the 21 most significant bits of the ordered coordinate bits
+static inline uint64_t MortonKey(const Node& n)
+{
+	return SpreadBits21(OrderedBits(n.x) >> 43)
+		 | (SpreadBits21(OrderedBits(n.y) >> 43) << 1)
+		 | (SpreadBits21(OrderedBits(n.z) >> 43) << 2);
+}
+
+///	total order of nodes which is used for the canonical order
+/**	Nodes which are the same for NodeHashIndex are equivalent.*/
+static inline bool CanonicalLess(const Node& n1, uint64_t key1, const Node& n2, uint64_t key2)
+{
+	if(key1 != key2)
+		return key1 < key2;
+	for(int i = 0; i < 3; ++i){
+		const uint64_t b1 = OrderedBits(n1.coord[i]);
+		const uint64_t b2 = OrderedBits(n2.coord[i]);
+		if(b1 != b2)
+			return b1 < b2;
+	}
+	return false;
+}
+
+
+///	sorts 'inds' by 'keys[inds[i]]' through a least significant digit radix sort
+static void RadixSortByKey(vector<uint>& inds, const vector<uint64_t>& keys)
+{
+	const size_t num = inds.size();
+	vector<uint> tmp(num);
+	vector<size_t> counts(1 << 16);
+
+	for(int shift = 0; shift < 64; shift += 16){
+		fill(counts.begin(), counts.end(), 0);
+		for(size_t i = 0; i < num; ++i)
+			++counts[(keys[inds[i]] >> shift) & 0xFFFF];
+
+	//	all keys share this digit. The order doesn't change.
+		if(counts[(keys[inds[0]] >> shift) & 0xFFFF] == num)
+			continue;
+
+		size_t offset = 0;
+		for(size_t i = 0; i < counts.size(); ++i){
+			const size_t c = counts[i];
+			counts[i] = offset;
+			offset += c;
+		}
+
+		for(size_t i = 0; i < num; ++i)
+			tmp[counts[(keys[inds[i]] >> shift) & 0xFFFF]++] = inds[i];
+		inds.swap(tmp);
+	}
+}
+
+
 ostream& operator << (ostream& out, const Position& p)
 {
 	out << "(" << p.x << ", " << p.y << ", " << p.z << ")[" << p.ci << "]";
@@ -27,162 +108,364 @@ ostream& operator << (ostream& out, const Position& p)
 }
 
 
-AlgebraicVector& AlgebraicVector::
-add_vector(const AlgebraicVector& av)
+static number g_matchTolerance = 0;
+
+void SetMatchTolerance(number eps)
 {
-//  iterate over all entries of av. If the position matches with an entry of
-//  this vector, then add the values. If not, insert the value and its position
-//  into this vector.
+	g_matchTolerance = max<number>(eps, 0);
+}
 
-    assert(av.positions.size() == av.data.size());
-    assert(positions.size() == data.size());
 
-    if(worldDim == 0){
-        assert(positions.size() == 0);
-        worldDim = av.worldDim;
-    }
-    else{
-        if(worldDim != av.worldDim){
-            cout << "ERROR -- Can't add vectors with different world dimensions!" << endl;
-            return *this;
-        }
-    }
+number MatchTolerance()
+{
+	return g_matchTolerance;
+}
 
-    typedef map<Position, size_t>   PosMap;
-    PosMap  posMap;
-    for(size_t i = 0; i < positions.size(); ++i)
-        posMap[positions[i]] = i;
-
-    for(size_t i_av = 0; i_av < av.positions.size(); ++i_av){
-        const Position& p_av = av.positions[i_av];
-        PosMap::iterator piter = posMap.find(p_av);
-        if(piter == posMap.end()){
-            positions.push_back(p_av);
-            data.push_back(av.data[i_av]);
-        }
-        else{
-            data[piter->second] += av.data[i_av];
-        }
-    }
 
-    return *this;
+const uint NodeHashIndex::INVALID;
+const uint NodeGridIndex::INVALID;
+const uint MergeIndex::INVALID;
+
+void MergeIndex::
+init(const AlgebraicVector& av)
+{
+	tolerance = MatchTolerance();
+	nodeIndex.clear();
+	gridIndex.clear();
+	if(tolerance > 0)
+		gridIndex.set_tolerance(tolerance);
+
+	reserve(av.nodes.size());
+	for(size_t i = 0; i < av.nodes.size(); ++i)
+		find_or_insert(av.nodes[i], (uint)i, av.nodes);
+
+	entryMap.clear();
+	entryMap.resize(av.comps.size());
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const Array<uint>& compNodes = av.comps[ci].nodes;
+		entryMap[ci].resize(av.nodes.size(), INVALID);
+		for(size_t i = 0; i < compNodes.size(); ++i)
+			entryMap[ci][compNodes[i]] = (uint)i;
+	}
 }
 
 
-AlgebraicVector& AlgebraicVector::
-add_vector(const AlgebraicVector& av, std::map<Position, size_t>& globPosMap)
+bool AlgebraicVector::
+merge(const AlgebraicVector& av, MergeIndex& index, bool addValues)
 {
 //  iterate over all entries of av. If the position matches with an entry of
-//  this vector, then add the values. If not, insert the value and its position
-//  into this vector.
+//  this vector, then add the values (or ignore them if addValues == false).
+//	If not, insert the value and its position into this vector.
 
-    assert(av.positions.size() == av.data.size());
-    assert(positions.size() == data.size());
+	m_canonical = false;
 
     if(worldDim == 0){
-        assert(positions.size() == 0);
+        assert(nodes.size() == 0);
         worldDim = av.worldDim;
     }
-    else{
-        if(worldDim != av.worldDim){
-            cout << "ERROR -- Can't add vectors with different world dimensions!" << endl;
-            return *this;
-        }
-    }
+    else if(worldDim != av.worldDim)
+        return false;
+
+//	find the nodes of av in this vector and insert missing ones
+	vector<uint> avToThis(av.nodes.size());
+	index.reserve(nodes.size() + av.nodes.size());
+	for(size_t i = 0; i < av.nodes.size(); ++i){
+		const uint newInd = (uint)nodes.size();
+		const uint ind = index.find_or_insert(av.nodes[i], newInd, nodes);
+		if(ind == newInd)
+			add_node(av.nodes[i]);
+		avToThis[i] = ind;
+	}
+
+	if(comps.size() < av.comps.size())
+		comps.resize(av.comps.size());
+	if(index.entryMap.size() < comps.size())
+		index.entryMap.resize(comps.size());
+
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const Component& avComp = av.comps[ci];
+		Component& comp = comps[ci];
+		vector<uint>& entryMap = index.entryMap[ci];
+		entryMap.resize(nodes.size(), MergeIndex::INVALID);
+
+		assert(avComp.nodes.size() == avComp.data.size());
+		for(size_t i_av = 0; i_av < avComp.data.size(); ++i_av){
+			const uint node = avToThis[avComp.nodes[i_av]];
+			uint& entry = entryMap[node];
+			if(entry == MergeIndex::INVALID){
+				entry = (uint)comp.data.size();
+				comp.nodes.push_back(node);
+				comp.data.push_back(avComp.data[i_av]);
+			}
+			else if(addValues)
+				comp.data[entry] += avComp.data[i_av];
+		}
+	}
+
+	return true;
+}
 
-    for(size_t i_av = 0; i_av < av.positions.size(); ++i_av){
-        const Position& p_av = av.positions[i_av];
-        std::map<Position, size_t>::iterator piter = globPosMap.find(p_av);
-        if(piter == globPosMap.end()){
-            positions.push_back(p_av);
-            data.push_back(av.data[i_av]);
-            globPosMap[p_av] = positions.size()-1;
-        }
-        else{
-            data[piter->second] += av.data[i_av];
-        }
-    }
 
-    return *this;
+bool AlgebraicVector::
+merge_canonical(const AlgebraicVector& av, MergeMode mode)
+{
+	if(!(m_canonical && av.m_canonical) || MatchTolerance() > 0)
+		return false;
+
+	if(worldDim != 0 && worldDim != av.worldDim)
+		return false;
+
+//	merge the node arrays. The order of both arrays is validated on the fly.
+//	Nodes are read through a const reference, since the non-const accessors
+//	of Array would copy nodes which reference external memory.
+	const Array<Node>& thisNodes = nodes;
+	Array<Node> newNodes;
+	newNodes.reserve(thisNodes.size() + av.nodes.size());
+	vector<uint> thisToNew(thisNodes.size());
+	vector<uint> avToNew(av.nodes.size());
+
+	size_t i1 = 0, i2 = 0;
+	uint64_t key1 = i1 < thisNodes.size() ? MortonKey(thisNodes[i1]) : 0;
+	uint64_t key2 = i2 < av.nodes.size() ? MortonKey(av.nodes[i2]) : 0;
+
+	while(i1 < thisNodes.size() || i2 < av.nodes.size()){
+		const bool take1 = i1 < thisNodes.size()
+						   && (i2 == av.nodes.size()
+						   	   || !CanonicalLess(av.nodes[i2], key2, thisNodes[i1], key1));
+		const bool take2 = i2 < av.nodes.size()
+						   && (i1 == thisNodes.size()
+						   	   || !CanonicalLess(thisNodes[i1], key1, av.nodes[i2], key2));
+
+		const uint newInd = (uint)newNodes.size();
+		CHECK(newInd < numeric_limits<uint>::max(), "Too many nodes in AlgebraicVector.");
+		newNodes.push_back(take1 ? thisNodes[i1] : av.nodes[i2]);
+
+		if(take1){
+			thisToNew[i1++] = newInd;
+			if(i1 < thisNodes.size()){
+				const uint64_t key = MortonKey(thisNodes[i1]);
+				if(!CanonicalLess(thisNodes[i1 - 1], key1, thisNodes[i1], key))
+					return false;
+				key1 = key;
+			}
+		}
+
+		if(take2){
+			avToNew[i2++] = newInd;
+			if(i2 < av.nodes.size()){
+				const uint64_t key = MortonKey(av.nodes[i2]);
+				if(!CanonicalLess(av.nodes[i2 - 1], key2, av.nodes[i2], key))
+					return false;
+				key2 = key;
+			}
+		}
+	}
+
+//	merge the entries of each component. Both node mappings are monotonic,
+//	so entries sorted by their nodes stay sorted.
+	vector<Component> newComps(max(comps.size(), av.comps.size()));
+	for(size_t ci = 0; ci < newComps.size(); ++ci){
+		static const Component emptyComp;
+		const Component& c1 = ci < comps.size() ? comps[ci] : emptyComp;
+		const Component& c2 = ci < av.comps.size() ? av.comps[ci] : emptyComp;
+		Component& nc = newComps[ci];
+		nc.nodes.reserve(c1.nodes.size() + c2.nodes.size());
+		nc.data.reserve(c1.nodes.size() + c2.nodes.size());
+
+		size_t e1 = 0, e2 = 0;
+		const size_t num1 = c1.nodes.size(), num2 = c2.nodes.size();
+		while(e1 < num1 || e2 < num2){
+			const uint n1 = e1 < num1 ? thisToNew[c1.nodes[e1]] : MergeIndex::INVALID;
+			const uint n2 = e2 < num2 ? avToNew[c2.nodes[e2]] : MergeIndex::INVALID;
+
+			if(n1 < n2){
+				nc.nodes.push_back(n1);
+				nc.data.push_back(c1.data[e1]);
+				++e1;
+			}
+			else if(n2 < n1){
+				nc.nodes.push_back(n2);
+				nc.data.push_back(mode == MERGE_SUBTRACT ? -c2.data[e2] : c2.data[e2]);
+				++e2;
+			}
+			else{
+				number val = c1.data[e1];
+				if(mode == MERGE_ADD)
+					val += c2.data[e2];
+				else if(mode == MERGE_SUBTRACT)
+					val = -(-val + c2.data[e2]);	// same result as with the index based merge
+				nc.nodes.push_back(n1);
+				nc.data.push_back(val);
+				++e1;
+				++e2;
+			}
+
+		//	entries have to be strictly ordered by their nodes
+			const size_t last = nc.nodes.size() - 1;
+			if(last > 0 && nc.nodes[last - 1] >= nc.nodes[last])
+				return false;
+		}
+	}
+
+	worldDim = av.worldDim;
+	nodes.swap(newNodes);
+	comps.swap(newComps);
+	m_canonical = true;
+	return true;
 }
 
+
 AlgebraicVector& AlgebraicVector::
-unite_with_vector(const AlgebraicVector& av)
+sort_canonical()
 {
-//  iterate over all entries of av. If the position matches with an entry of
-//  this vector, then ignore the values. If not, insert the value and its position
-//  into this vector.
+//	arrays are read through const references until they are replaced, since
+//	the non-const accessors of Array would copy external memory
+	const Array<Node>& oldNodes = nodes;
+	const size_t numNodes = oldNodes.size();
+
+	vector<uint64_t> keys(numNodes);
+	vector<uint> order(numNodes);
+	for(size_t i = 0; i < numNodes; ++i){
+		keys[i] = MortonKey(oldNodes[i]);
+		order[i] = (uint)i;
+	}
+
+	if(numNodes > 0)
+		RadixSortByKey(order, keys);
+
+//	nodes whose keys are equal are ordered by their exact coordinates
+	for(size_t i = 0; i < numNodes;){
+		size_t j = i + 1;
+		while(j < numNodes && keys[order[j]] == keys[order[i]])
+			++j;
+		if(j - i > 1){
+			sort(order.begin() + i, order.begin() + j,
+				 [&](uint a, uint b){
+					return CanonicalLess(oldNodes[a], keys[a], oldNodes[b], keys[b]);});
+		}
+		i = j;
+	}
+
+	vector<uint> oldToNew(numNodes);
+	Array<Node> newNodes(numNodes);
+	for(size_t i = 0; i < numNodes; ++i){
+		oldToNew[order[i]] = (uint)i;
+		newNodes[i] = oldNodes[order[i]];
+	}
+	nodes.swap(newNodes);
+
+//	sort the entries of each component by their new node indices. Since each
+//	node has at most one entry per component, the entries are simply scattered.
+	vector<uint> entryOfNode(numNodes, MergeIndex::INVALID);
+	for(size_t ci = 0; ci < comps.size(); ++ci){
+		Component& comp = comps[ci];
+		const Component& oldComp = comp;
+		const size_t numEntries = oldComp.nodes.size();
+		bool unique = true;
+		for(size_t i = 0; i < numEntries; ++i){
+			uint& e = entryOfNode[oldToNew[oldComp.nodes[i]]];
+			if(e != MergeIndex::INVALID)
+				unique = false;
+			e = (uint)i;
+		}
+
+		Component newComp;
+		newComp.nodes.reserve(numEntries);
+		newComp.data.reserve(numEntries);
+
+		if(unique){
+			for(size_t n = 0; n < numNodes; ++n){
+				uint& e = entryOfNode[n];
+				if(e != MergeIndex::INVALID){
+					newComp.nodes.push_back((uint)n);
+					newComp.data.push_back(oldComp.data[e]);
+					e = MergeIndex::INVALID;
+				}
+			}
+		}
+		else{
+			vector<uint> entries(numEntries);
+			for(size_t i = 0; i < numEntries; ++i){
+				entries[i] = (uint)i;
+				entryOfNode[oldToNew[oldComp.nodes[i]]] = MergeIndex::INVALID;
+			}
+			stable_sort(entries.begin(), entries.end(),
+						[&](uint a, uint b){
+							return oldToNew[oldComp.nodes[a]] < oldToNew[oldComp.nodes[b]];});
+			for(size_t i = 0; i < numEntries; ++i){
+				newComp.nodes.push_back(oldToNew[oldComp.nodes[entries[i]]]);
+				newComp.data.push_back(oldComp.data[entries[i]]);
+			}
+		}
+
+		comp.nodes.swap(newComp.nodes);
+		comp.data.swap(newComp.data);
+	}
+
+//	the merge-join requires unique entries per node and component
+	m_canonical = true;
+	for(size_t ci = 0; ci < comps.size() && m_canonical; ++ci){
+		const Array<uint>& compNodes = comps[ci].nodes;
+		for(size_t i = 1; i < compNodes.size(); ++i){
+			if(compNodes[i - 1] == compNodes[i]){
+				m_canonical = false;
+				break;
+			}
+		}
+	}
 
-    assert(av.positions.size() == av.data.size());
-    assert(positions.size() == data.size());
+	return *this;
+}
 
-    if(worldDim == 0){
-        assert(positions.size() == 0);
-        worldDim = av.worldDim;
-    }
-    else{
-        if(worldDim != av.worldDim){
-            cout << "ERROR -- Can't unite vectors with different world dimensions!" << endl;
-            return *this;
-        }
-    }
 
-    typedef map<Position, size_t>   PosMap;
-    PosMap  posMap;
-    for(size_t i = 0; i < positions.size(); ++i)
-        posMap[positions[i]] = i;
+AlgebraicVector& AlgebraicVector::
+add_vector(const AlgebraicVector& av)
+{
+	if(merge_canonical(av, MERGE_ADD))
+		return *this;
 
+	MergeIndex index;
+	index.init(*this);
+	return add_vector(av, index);
+}
 
-    for(size_t i_av = 0; i_av < av.positions.size(); ++i_av){
-        const Position& p_av = av.positions[i_av];
-        PosMap::iterator piter = posMap.find(p_av);
-        if(piter == posMap.end()){
-            positions.push_back(p_av);
-            data.push_back(av.data[i_av]);
-        }
-    }
 
-    return *this;
+AlgebraicVector& AlgebraicVector::
+add_vector(const AlgebraicVector& av, MergeIndex& globIndex)
+{
+	if(!merge(av, globIndex, true))
+		cout << "ERROR -- Can't add vectors with different world dimensions!" << endl;
+	return *this;
 }
 
 
 AlgebraicVector& AlgebraicVector::
-unite_with_vector(const AlgebraicVector& av, std::map<Position, size_t>& globPosMap)
+unite_with_vector(const AlgebraicVector& av)
 {
-//  iterate over all entries of av. If the position matches with an entry of
-//  this vector, then ignore the values. If not, insert the value and its position
-//  into this vector.
+	if(merge_canonical(av, MERGE_UNITE))
+		return *this;
 
-    assert(av.positions.size() == av.data.size());
-    assert(positions.size() == data.size());
-
-    if(worldDim == 0){
-        assert(positions.size() == 0);
-        worldDim = av.worldDim;
-    }
-    else{
-        if(worldDim != av.worldDim){
-            cout << "ERROR -- Can't unite vectors with different world dimensions!" << endl;
-            return *this;
-        }
-    }
+	MergeIndex index;
+	index.init(*this);
+	return unite_with_vector(av, index);
+}
 
-    for(size_t i_av = 0; i_av < av.positions.size(); ++i_av){
-        const Position& p_av = av.positions[i_av];
-        std::map<Position, size_t>::iterator piter = globPosMap.find(p_av);
-        if(piter == globPosMap.end()){
-            positions.push_back(p_av);
-            data.push_back(av.data[i_av]);
-            globPosMap[p_av] = positions.size()-1;
-        }
-    }
 
-    return *this;
+AlgebraicVector& AlgebraicVector::
+unite_with_vector(const AlgebraicVector& av, MergeIndex& globIndex)
+{
+	if(!merge(av, globIndex, false))
+		cout << "ERROR -- Can't unite vectors with different world dimensions!" << endl;
+	return *this;
 }
 
+
 AlgebraicVector& AlgebraicVector::
 subtract_vector(const AlgebraicVector& av)
 {
+	if(merge_canonical(av, MERGE_SUBTRACT))
+		return *this;
+
 //	scale local data by -1, add the vector and scale the data by -1 again.
 	multiply_scalar(-1.);
 	add_vector(av);
@@ -193,25 +476,88 @@ subtract_vector(const AlgebraicVector& av)
 AlgebraicVector& AlgebraicVector::
 multiply_scalar(number s)
 {
-	for(size_t i = 0; i < data.size(); ++i)
-		data[i] *= s;
+	for(size_t ci = 0; ci < comps.size(); ++ci){
+		const size_t num = comps[ci].data.size();
+		number* data = comps[ci].data.data();
+		for(size_t i = 0; i < num; ++i)
+			data[i] *= s;
+	}
 	return *this;
 }
 
 
-int AlgebraicVector::
-max_component_index() const
+size_t AlgebraicVector::
+num_entries() const
+{
+	size_t num = 0;
+	for(size_t ci = 0; ci < comps.size(); ++ci)
+		num += comps[ci].data.size();
+	return num;
+}
+
+
+uint AlgebraicVector::
+add_node(const Node& n)
+{
+	CHECK(nodes.size() < (size_t)numeric_limits<uint>::max(),
+		  "Too many nodes in AlgebraicVector.");
+	m_canonical = false;
+	nodes.push_back(n);
+	return (uint)(nodes.size() - 1);
+}
+
+
+void AlgebraicVector::
+clear()
 {
-	int maxCI = -1;
-	for(size_t i = 0; i < positions.size(); ++i)
-		maxCI = max(maxCI, positions[i].ci);
-	return maxCI;
+	worldDim = 0;
+	nodes.clear();
+	comps.clear();
+	m_canonical = false;
 }
 
+
 void AlgebraicVector::
 swap (AlgebraicVector& av)
 {
     std::swap (worldDim, av.worldDim);
-    positions.swap (av.positions);
-    data.swap (av.data);
-}
\ No newline at end of file
+    std::swap (m_canonical, av.m_canonical);
+    nodes.swap (av.nodes);
+    comps.swap (av.comps);
+}
+
+
+void ViewArrays(AlgebraicVector& avOut, int worldDim, const number* coords,
+				size_t numNodes, const number* const* values, int numComps)
+{
+	CHECK(worldDim >= 1 && worldDim <= 3, "Invalid world dimension: " << worldDim);
+	CHECK(numNodes < (size_t)numeric_limits<uint>::max(),
+		  "Too many nodes in AlgebraicVector.");
+
+	avOut.clear();
+	avOut.worldDim = worldDim;
+
+	if(worldDim == 3){
+		static_assert(sizeof(Node) == 3 * sizeof(number), "Node has to consist of 3 packed coordinates");
+		avOut.nodes.set_view(reinterpret_cast<const Node*>(coords), numNodes);
+	}
+	else{
+		avOut.nodes.resize(numNodes);
+		Node* nodes = avOut.nodes.data();
+		for(size_t i = 0; i < numNodes; ++i){
+			for(int d = 0; d < worldDim; ++d)
+				nodes[i].coord[d] = coords[i * worldDim + d];
+		}
+	}
+
+	shared_ptr<vector<uint> > nodeInds(new vector<uint>(numNodes));
+	for(size_t i = 0; i < numNodes; ++i)
+		(*nodeInds)[i] = (uint)i;
+
+	avOut.comps.resize(numComps);
+	for(int ci = 0; ci < numComps; ++ci){
+		Component& comp = avOut.comps[ci];
+		comp.nodes.set_view(nodeInds->data(), numNodes, nodeInds);
+		comp.data.set_view(values[ci], numNodes);
+	}
+}
@@ -12,24 +12,21 @@
 #include <vector>
 #include <map>
 #include <iostream>
-#include "ugvec_base.h"
+#include "array.h"
+#include "ugvec_types.h"
 
 
-struct Position{
-	Position() : x(0), y(0), z(0), ci(0)	{}
-	
-	bool operator == (const Position& p) const
+///	coordinates of a node. Each node is stored only once in an AlgebraicVector.
+struct Node{
+	Node() : x(0), y(0), z(0)	{}
+
+	bool operator == (const Node& p) const
 	{
-		return x == p.x && y == p.y && z == p.z && ci == p.ci;
+		return x == p.x && y == p.y && z == p.z;
 	}
 
-	bool operator < (const Position& p) const
+	bool operator < (const Node& p) const
 	{
-		if(ci < p.ci)
-			return true;
-		else if(ci > p.ci)
-			return false;
-		
 		if(x < p.x)
 			return true;
 		else if(x > p.x)
@@ -47,7 +44,7 @@ struct Position{
 
 		return false;
 	}
-	
+
 	union {
 		struct {
 			number x;
@@ -57,7 +54,29 @@ struct Position{
 
 		number coord[3];
 	};
-	
+};
+
+
+///	coordinates of a node together with a component index
+struct Position : public Node{
+	Position() : ci(0)	{}
+	Position(const Node& n, int ci) : Node(n), ci(ci)	{}
+
+	bool operator == (const Position& p) const
+	{
+		return ci == p.ci && Node::operator == (p);
+	}
+
+	bool operator < (const Position& p) const
+	{
+		if(ci < p.ci)
+			return true;
+		else if(ci > p.ci)
+			return false;
+
+		return Node::operator < (p);
+	}
+
 	int ci;			///< component index
 };
 
@@ -65,37 +84,135 @@ struct Position{
 std::ostream& operator << (std::ostream& out, const Position& p);
 
 
+///	sets the distance up to which positions are matched during merges
+/**	By default (eps = 0) the coordinates of positions have to match exactly.
+ * If eps > 0, add_vector, unite_with_vector and subtract_vector associate
+ * each node with the nearest node of the target vector within the euclidean
+ * distance eps (see NodeGridIndex). The coordinates of the target vector are
+ * kept. eps should be clearly smaller than the distance between neighbouring
+ * nodes, otherwise distinct nodes are merged.*/
+void SetMatchTolerance(number eps);
+
+///	returns the tolerance set through SetMatchTolerance
+number MatchTolerance();
+
+
+///	data column of a single component of an AlgebraicVector
+/**	For each data entry, 'nodes' holds the index of the associated node in
+ * AlgebraicVector::nodes.*/
+struct Component{
+	Array<unsigned int>	nodes;
+	Array<number>	data;
+};
+
+
+struct MergeIndex;
+
+
+///	A vector whose entries are associated with nodes and components.
+/**	Node coordinates are stored only once in 'nodes'. Data entries are stored
+ * separately for each component in 'comps'. Each entry references its node
+ * through an index into 'nodes'.
+ *
+ * If entries are enumerated globally (e.g. for histograms), entries of
+ * component 0 come first, followed by entries of component 1, and so on.
+ *
+ * Node and data arrays may reference external memory (see Array), e.g.
+ * a memory-mapped file. They are copied on the first modification.*/
 struct AlgebraicVector{
-	AlgebraicVector() : worldDim(0)	{}
-	
+	AlgebraicVector() : worldDim(0), m_canonical(false)	{}
+
 ///	adds values with same positions and inserts the others
 /**	returns a reference to this vector, so that add_vector can be chained.*/
     AlgebraicVector& add_vector(const AlgebraicVector& av);
-    AlgebraicVector& add_vector(const AlgebraicVector& av, std::map<Position, size_t>& globPosMap);
+    AlgebraicVector& add_vector(const AlgebraicVector& av, MergeIndex& globIndex);
 
 ///	subtracts values with same positions.
 /**	If a position was not found in this vector, a default value of 0 will be assumed
  * returns a reference to this vector, so that add_vector can be chained.*/
 	AlgebraicVector& subtract_vector(const AlgebraicVector& av);
-	
+
 ///	inserts values from the specified vector which did not yet exist in this vector
 /**	returns a reference to this vector, so that unite_with_vector can be chained.*/
 	AlgebraicVector& unite_with_vector(const AlgebraicVector& av);
-	AlgebraicVector& unite_with_vector(const AlgebraicVector& av, std::map<Position, size_t>& globPosMap);
+	AlgebraicVector& unite_with_vector(const AlgebraicVector& av, MergeIndex& globIndex);
 
 ///	multiplies all data values by the given scalar
 	AlgebraicVector& multiply_scalar(number s);
-	
-///	returns the maximum component index stored in positions. ATTENTION: O(n)
-/** \return The highest component index in positions. -1 if positions is empty.*/
-	int max_component_index() const;
+
+///	brings nodes and entries into the canonical order
+/**	Nodes are sorted by the Z-order (Morton) key of their coordinates, so
+ * that spatially neighbouring nodes are close in memory. Ties are broken by
+ * the exact coordinates. The entries of each component are sorted by their
+ * nodes.
+ *
+ * If both vectors of add_vector, unite_with_vector or subtract_vector are in
+ * canonical order, the operation is performed as a linear merge-join and the
+ * result is in canonical order, too. Other operations (or direct
+ * modifications of 'nodes' and 'comps') may destroy the order. Since the
+ * merge-join validates the order of its inputs and falls back to the
+ * index based merge if necessary, this never leads to wrong results.*/
+	AlgebraicVector& sort_canonical();
+
+///	returns true if the vector was brought into canonical order and no method modified it since.
+	bool is_canonical() const		{return m_canonical;}
+
+///	returns the maximum component index.
+/** \return The highest component index. -1 if there are no components.*/
+	int max_component_index() const	{return (int)comps.size() - 1;}
+
+	int num_components() const		{return (int)comps.size();}
+
+///	returns the total number of entries of all components. ATTENTION: O(#components)
+	size_t num_entries() const;
+
+///	returns the position of the i-th entry of component ci
+	Position position(int ci, size_t i) const
+	{
+		return Position(nodes[comps[ci].nodes[i]], ci);
+	}
+
+///	appends a node and returns its index
+	unsigned int add_node(const Node& n);
+
+	void clear();
 
 	void swap (AlgebraicVector& av);
-	
+
 	int	worldDim;
-	std::vector<Position>	positions;
-	std::vector<number>		data;
+	Array<Node>				nodes;
+	std::vector<Component>	comps;
+
+private:
+	enum MergeMode{
+		MERGE_ADD,
+		MERGE_UNITE,
+		MERGE_SUBTRACT
+	};
+
+	bool merge(const AlgebraicVector& av, MergeIndex& index, bool addValues);
+	bool merge_canonical(const AlgebraicVector& av, MergeMode mode);
+
+	bool	m_canonical;
 };
 
 
+///	makes 'avOut' reference caller-owned coordinates and values without copying them
+/**	'coords' holds worldDim coordinates for each of the numNodes nodes
+ * (x0, y0, z0, x1, y1, ...). 'values' holds numComps pointers to arrays of
+ * numNodes values each, where values[ci][i] is the value of component ci at
+ * node i. Coordinates have to be unique, like the nodes of loaded vectors.
+ *
+ * Values are never copied. Coordinates are referenced if worldDim is 3 and
+ * expanded to 3d nodes otherwise. The node indices of the entries are
+ * created once and shared by all components. The caller's arrays have to
+ * stay valid and unchanged as long as 'avOut' or a copy of it references
+ * them. Operations which modify 'avOut' (e.g. subtract_vector) copy the
+ * referenced arrays first (see Array), so the caller's arrays are never
+ * written. Use ComputeDifferenceStatistics to compare 'avOut' against other
+ * vectors without copying.*/
+void ViewArrays(AlgebraicVector& avOut, int worldDim, const number* coords,
+				size_t numNodes, const number* const* values, int numComps);
+
+
 #endif	//__H__algebraic_vector
@@ -0,0 +1,133 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_array
+#define __H__ugvec_array
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+///	Contiguous array which either owns its elements or references external memory.
+/**	An Array behaves like a std::vector. Additionally it can reference
+ * memory which is owned by someone else (e.g. a memory-mapped file or an
+ * array of the caller of a library function) through 'set_view'. Such views
+ * are read-only: the first modifying access copies the referenced elements
+ * into memory owned by the array (copy on write).
+ *
+ * The optional 'keepAlive' object of a view is held until the view is
+ * released, so that e.g. a memory mapping stays valid as long as it is
+ * referenced. Copies of a view reference the same memory.*/
+template <class T>
+class Array{
+	public:
+		typedef T			value_type;
+		typedef T*			iterator;
+		typedef const T*	const_iterator;
+
+		Array() : m_view(NULL), m_viewSize(0)	{}
+
+		explicit Array(size_t size, const T& val = T()) :
+			m_vec(size, val), m_view(NULL), m_viewSize(0)	{}
+
+		Array(const std::vector<T>& v) :
+			m_vec(v), m_view(NULL), m_viewSize(0)	{}
+
+		Array& operator = (const std::vector<T>& v)
+		{
+			release_view();
+			m_vec = v;
+			return *this;
+		}
+
+	///	references 'size' elements at 'p' without copying them.
+		void set_view(const T* p, size_t size,
+					  const std::shared_ptr<const void>& keepAlive = std::shared_ptr<const void>())
+		{
+			std::vector<T>().swap(m_vec);
+			m_view = p;
+			m_viewSize = size;
+			m_keepAlive = keepAlive;
+		}
+
+	///	returns true if the array references external memory
+		bool is_view() const			{return m_view != NULL;}
+
+		size_t size() const				{return m_view ? m_viewSize : m_vec.size();}
+		bool empty() const				{return size() == 0;}
+
+		const T* data() const			{return m_view ? m_view : m_vec.data();}
+		T* data()						{detach(); return m_vec.data();}
+
+		const T& operator [] (size_t i) const	{return data()[i];}
+		T& operator [] (size_t i)				{detach(); return m_vec[i];}
+
+		const_iterator begin() const	{return data();}
+		const_iterator end() const		{return data() + size();}
+		iterator begin()				{return data();}
+		iterator end()					{return data() + size();}
+
+		const T& front() const			{return data()[0];}
+		const T& back() const			{return data()[size() - 1];}
+		T& back()						{detach(); return m_vec.back();}
+
+		void push_back(const T& val)	{detach(); m_vec.push_back(val);}
+
+		void resize(size_t size, const T& val = T())
+		{
+			detach();
+			m_vec.resize(size, val);
+		}
+
+		void reserve(size_t size)		{detach(); m_vec.reserve(size);}
+
+		template <class TIter>
+		void assign(TIter first, TIter last)
+		{
+			release_view();
+			m_vec.assign(first, last);
+		}
+
+		void clear()
+		{
+			release_view();
+			m_vec.clear();
+		}
+
+		void swap(Array& a)
+		{
+			m_vec.swap(a.m_vec);
+			std::swap(m_view, a.m_view);
+			std::swap(m_viewSize, a.m_viewSize);
+			m_keepAlive.swap(a.m_keepAlive);
+		}
+
+	private:
+	///	copies referenced elements into owned memory
+		void detach()
+		{
+			if(m_view){
+				m_vec.assign(m_view, m_view + m_viewSize);
+				release_view();
+			}
+		}
+
+		void release_view()
+		{
+			m_view = NULL;
+			m_viewSize = 0;
+			m_keepAlive.reset();
+		}
+
+		std::vector<T>					m_vec;
+		const T*						m_view;
+		size_t							m_viewSize;
+		std::shared_ptr<const void>		m_keepAlive;
+};
+
+#endif	//__H__ugvec_array
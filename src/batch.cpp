@@ -0,0 +1,344 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "algebraic_vector.h"
+#include "batch.h"
+#include "file_io.h"
+#include "parallel.h"
+#include "ugvec_base.h"
+#include "vec_tools.h"
+
+using namespace std;
+
+namespace{
+
+///	a parsed command of a batch script
+struct BatchCommand{
+	BatchCommand() :
+		line(0), output(-1), makeConsistent(true), component(-1),
+		histoSecs(5), histoAbs(false), histoLog(false)
+	{}
+
+	int				line;
+	string			text;
+	string			cmd;
+///	file arguments
+	vector<string>	files;
+///	slots of the vectors which are read and the slot which is written (or -1)
+	vector<int>		inputs;
+	int				output;
+///	commands which access the same files and have to be executed before
+	vector<int>		after;
+
+	bool			makeConsistent;
+	int				component;
+	int				histoSecs;
+	bool			histoAbs;
+	bool			histoLog;
+};
+
+
+///	parses a line into cmd. Returns false and prints an error on failure.
+/**	'slotOfName' maps names to the slots of their latest definitions and is
+ * updated if the command defines a vector. numSlots is the number of slots
+ * created so far.
+ *
+ * 'slotOfLoad' maps the file and the options of each load to the slot it
+ * was loaded into (like the key of serve's VectorCache). A load of a file
+ * which was already loaded with the same options doesn't create a new slot.
+ * Instead, the command reads the existing slot and its name is associated
+ * with that slot, so that both names share the vector. Commands which write
+ * a file remove its loads from 'slotOfLoad', so that later loads read the
+ * new file.*/
+bool ParseCommand(BatchCommand& cmd, const vector<string>& tokens,
+				  map<string, int>& slotOfName, map<string, int>& slotOfLoad,
+				  int& numSlots)
+{
+	const string& c = tokens[0];
+	cmd.cmd = c;
+
+	vector<string> args;
+	for(size_t i = 1; i < tokens.size(); ++i){
+		const string& t = tokens[i];
+		if(t == "-consistent")
+			cmd.makeConsistent = false;
+		else if(t == "-histoAbs")
+			cmd.histoAbs = true;
+		else if(t == "-histoLog"){
+			cmd.histoLog = true;
+			cmd.histoAbs = true;
+		}
+		else if((t == "-component" || t == "-histoSecs") && i + 1 < tokens.size()){
+			const int val = atoi(tokens[++i].c_str());
+			if(t == "-component")
+				cmd.component = val;
+			else
+				cmd.histoSecs = val;
+		}
+		else if(!t.empty() && t[0] == '-'){
+			LOG("ERROR -- line " << cmd.line << ": invalid option " << t << endl);
+			return false;
+		}
+		else
+			args.push_back(t);
+	}
+
+//	number of names read, of files and whether the first argument defines a name
+	size_t numIn = 0, numFiles = 0, numOptIn = 0;
+	bool defines = false;
+	if(c == "load")				{defines = true; numFiles = 1;}
+	else if(c == "dif")			{defines = true; numIn = 2;}
+	else if(c == "norms")		{numIn = 1; numOptIn = 1;}
+	else if(c == "minmax")		{numIn = 1;}
+	else if(c == "info")		{numIn = 1;}
+	else if(c == "histogram")	{numIn = 1; numFiles = 1;}
+	else if(c == "save")		{numIn = 1; numFiles = 1;}
+	else{
+		LOG("ERROR -- line " << cmd.line << ": unknown command " << c << endl);
+		return false;
+	}
+
+	const size_t numArgs = (defines ? 1 : 0) + numIn + numFiles;
+	if(args.size() < numArgs || args.size() > numArgs + numOptIn){
+		LOG("ERROR -- line " << cmd.line << ": wrong number of arguments for " << c << endl);
+		return false;
+	}
+
+	size_t iarg = defines ? 1 : 0;
+	for(; iarg < args.size() - numFiles; ++iarg){
+		map<string, int>::const_iterator it = slotOfName.find(args[iarg]);
+		if(it == slotOfName.end()){
+			LOG("ERROR -- line " << cmd.line << ": unknown vector " << args[iarg] << endl);
+			return false;
+		}
+		cmd.inputs.push_back(it->second);
+	}
+	for(; iarg < args.size(); ++iarg)
+		cmd.files.push_back(args[iarg]);
+
+	if(c == "load"){
+		ostringstream key;
+		key << cmd.files[0] << '\n' << cmd.makeConsistent << '\n' << cmd.component;
+		map<string, int>::const_iterator it = slotOfLoad.find(key.str());
+		if(it != slotOfLoad.end()){
+			cmd.inputs.push_back(it->second);
+			slotOfName[args[0]] = it->second;
+			return true;
+		}
+		slotOfLoad[key.str()] = numSlots;
+	}
+	else if(!cmd.files.empty()){
+		const string prefix = cmd.files[0] + '\n';
+		map<string, int>::iterator it = slotOfLoad.lower_bound(prefix);
+		while(it != slotOfLoad.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+			slotOfLoad.erase(it++);
+	}
+
+	if(defines){
+		cmd.output = numSlots++;
+		slotOfName[args[0]] = cmd.output;
+	}
+	return true;
+}
+
+
+void ExecuteCommand(const BatchCommand& cmd, vector<shared_ptr<AlgebraicVector> >& slots,
+					ostream& out, bool canonical)
+{
+	out << "== line " << cmd.line << ": " << cmd.text << endl;
+
+	vector<const AlgebraicVector*> in;
+	for(size_t i = 0; i < cmd.inputs.size(); ++i)
+		in.push_back(slots[cmd.inputs[i]].get());
+
+	if(cmd.cmd == "load" && !in.empty())
+		out << "INFO -- using loaded vector from " << cmd.files[0] << endl;
+	else if(cmd.cmd == "load"){
+		shared_ptr<AlgebraicVector> av(new AlgebraicVector);
+		CHECK(LoadVector(*av, cmd.files[0].c_str(), cmd.makeConsistent, cmd.component),
+			  "line " << cmd.line << ": Couldn't load " << cmd.files[0]);
+		if(canonical)
+			av->sort_canonical();
+		slots[cmd.output] = av;
+	}
+	else if(cmd.cmd == "dif"){
+		shared_ptr<AlgebraicVector> av(new AlgebraicVector(*in[0]));
+		av->subtract_vector(*in[1]);
+		vector<ComponentStatistics> stats;
+		ComputeStatistics(stats, *av);
+		PrintMinMax(*av, &stats, out);
+		slots[cmd.output] = av;
+	}
+	else if(cmd.cmd == "norms"){
+		vector<ComponentNorms> norms;
+		ComputeNorms(norms, *in[0]);
+		if(in.size() == 2){
+			AlgebraicVector difVec(*in[0]);
+			difVec.subtract_vector(*in[1]);
+			vector<ComponentNorms> refNorms;
+			refNorms.swap(norms);
+			ComputeNorms(norms, difVec);
+			out << "Norms of v1-v2 (relative to v1):" << endl;
+			PrintNorms(norms, &refNorms, out);
+		}
+		else
+			PrintNorms(norms, NULL, out);
+	}
+	else if(cmd.cmd == "minmax")
+		PrintMinMax(*in[0], NULL, out);
+	else if(cmd.cmd == "info"){
+		vector<ComponentStatistics> stats;
+		ComputeStatistics(stats, *in[0]);
+		PrintInfo(*in[0], &stats, out);
+	}
+	else if(cmd.cmd == "histogram"){
+		CHECK(SaveHistogramToUGX(*in[0], cmd.files[0].c_str(), cmd.histoSecs,
+								 cmd.histoAbs, cmd.histoLog, NULL, out),
+			  "line " << cmd.line << ": Couldn't write " << cmd.files[0]);
+	}
+	else if(cmd.cmd == "save"){
+		CHECK(SaveVector(*in[0], cmd.files[0].c_str()),
+			  "line " << cmd.line << ": Couldn't write " << cmd.files[0]);
+	}
+}
+
+}//	end of anonymous namespace
+
+
+bool RunBatch(const char* scriptFile, bool canonical)
+{
+	ifstream in(scriptFile);
+	if(!in){
+		LOG("ERROR -- File not found: " << scriptFile << endl);
+		return false;
+	}
+
+	vector<BatchCommand> cmds;
+	map<string, int> slotOfName;
+	map<string, int> slotOfLoad;
+	int numSlots = 0;
+
+	string line;
+	for(int lineNum = 1; getline(in, line); ++lineNum){
+		istringstream ss(line);
+		vector<string> tokens;
+		string t;
+		while(ss >> t)
+			tokens.push_back(t);
+		if(tokens.empty() || tokens[0][0] == '#')
+			continue;
+
+		BatchCommand cmd;
+		cmd.line = lineNum;
+		cmd.text = line;
+		if(!ParseCommand(cmd, tokens, slotOfName, slotOfLoad, numSlots))
+			return false;
+		cmds.push_back(cmd);
+	}
+
+//	producer of each slot and the number of commands which still have to read it
+	vector<int> producer(numSlots, -1);
+	vector<int> numReaders(numSlots, 0);
+	vector<bool> isLatest(numSlots, false);
+	for(size_t i = 0; i < cmds.size(); ++i){
+		if(cmds[i].output >= 0)
+			producer[cmds[i].output] = (int)i;
+		for(size_t j = 0; j < cmds[i].inputs.size(); ++j)
+			++numReaders[cmds[i].inputs[j]];
+	}
+
+//	a file is read after the last command which wrote it before and written
+//	after all commands which accessed it before. Files are identified by
+//	their paths as given in the script.
+	map<string, int> lastWriter;
+	map<string, vector<int> > readersSinceWrite;
+	for(size_t i = 0; i < cmds.size(); ++i){
+		BatchCommand& cmd = cmds[i];
+		if(cmd.files.empty())
+			continue;
+		const string& file = cmd.files[0];
+		map<string, int>::const_iterator writer = lastWriter.find(file);
+		if(writer != lastWriter.end())
+			cmd.after.push_back(writer->second);
+
+		if(cmd.cmd == "load")
+			readersSinceWrite[file].push_back((int)i);
+		else{
+			vector<int>& readers = readersSinceWrite[file];
+			cmd.after.insert(cmd.after.end(), readers.begin(), readers.end());
+			readers.clear();
+			lastWriter[file] = (int)i;
+		}
+	}
+	for(map<string, int>::const_iterator it = slotOfName.begin(); it != slotOfName.end(); ++it)
+		isLatest[it->second] = true;
+
+	vector<shared_ptr<AlgebraicVector> > slots(numSlots);
+	vector<bool> done(cmds.size(), false);
+	size_t numDone = 0;
+
+//	outputs are kept until the outputs of all previous commands were printed
+	vector<string> outputs(cmds.size());
+	size_t numPrinted = 0;
+
+	while(numDone < cmds.size()){
+	//	all commands whose inputs are available form the next wave
+		vector<size_t> wave;
+		for(size_t i = 0; i < cmds.size(); ++i){
+			if(done[i])
+				continue;
+			bool ready = true;
+			for(size_t j = 0; j < cmds[i].inputs.size(); ++j)
+				ready = ready && done[producer[cmds[i].inputs[j]]];
+			for(size_t j = 0; j < cmds[i].after.size(); ++j)
+				ready = ready && done[cmds[i].after[j]];
+			if(ready)
+				wave.push_back(i);
+		}
+
+		ParallelFor(wave.size(), NumThreads(),
+			[&](size_t i){
+				ostringstream out;
+				ExecuteCommand(cmds[wave[i]], slots, out, canonical);
+				outputs[wave[i]] = out.str();
+			});
+
+		for(size_t i = 0; i < wave.size(); ++i){
+			const BatchCommand& cmd = cmds[wave[i]];
+			done[wave[i]] = true;
+			++numDone;
+
+		//	vectors which were redefined are released after their last use
+			for(size_t j = 0; j < cmd.inputs.size(); ++j){
+				const int slot = cmd.inputs[j];
+				if(--numReaders[slot] == 0 && !isLatest[slot])
+					slots[slot].reset();
+			}
+			if(cmd.output >= 0 && numReaders[cmd.output] == 0 && !isLatest[cmd.output])
+				slots[cmd.output].reset();
+		}
+
+		for(; numPrinted < cmds.size() && done[numPrinted]; ++numPrinted){
+			cout << outputs[numPrinted];
+			outputs[numPrinted].clear();
+		}
+		cout << flush;
+	}
+
+	return true;
+}
@@ -0,0 +1,43 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_batch
+#define __H__ugvec_batch
+
+///	executes the commands of a batch script in one process
+/**	Each line of the script contains one command. Empty lines and lines
+ * starting with '#' are ignored. Vectors are referenced by names:
+ *
+ *	load name file [-consistent] [-component n]
+ *	dif name a b					name = a - b. Prints min/max of the result.
+ *	norms a [b]						norms of a, or of a - b relative to a
+ *	minmax a
+ *	info a
+ *	histogram a file.ugx [-histoSecs n] [-histoAbs] [-histoLog]
+ *	save a file
+ *
+ * Each file is loaded once and the vector stays cached under its name. Loads
+ * of the same file with the same options share one vector, even under
+ * different names. A name may be redefined by a later 'load' or 'dif';
+ * commands always refer to the latest definition before them.
+ *
+ * Commands whose input vectors are available are executed concurrently by
+ * NumThreads() threads (see parallel.h), in waves. A file which is written
+ * by 'save' or 'histogram' is only loaded after it was written and only
+ * overwritten after earlier loads of it finished. Later loads of such a file
+ * don't share the vector of earlier loads. Files are identified by their
+ * paths as given in the script. The output of each command is collected and
+ * printed in script order. Only the log messages of loads and saves are
+ * printed immediately.
+ *
+ * If canonical is true, loaded vectors are brought into canonical order.
+ * Returns false if the script can't be read or contains an invalid command.
+ * Errors during execution throw UGVecError, like CHECK.*/
+bool RunBatch(const char* scriptFile, bool canonical);
+
+#endif	//__H__ugvec_batch
@@ -15,10 +15,27 @@
 
 #include "algebraic_vector.h"
 #include "file_io.h"
+#include "merge_index.h"
+#include "parallel.h"
+#include "sharded_merge.h"
 #include "vec_tools.h"
 
 using namespace std;
 
+static bool g_verifyFiles = false;
+
+void SetVerifyFiles(bool verify)
+{
+	g_verifyFiles = verify;
+}
+
+
+bool VerifyFiles()
+{
+	return g_verifyFiles;
+}
+
+
 bool LoadVector(AlgebraicVector& av, const char* filename,
 				bool makeConsistent, int component)
 {
@@ -26,7 +43,9 @@ bool LoadVector(AlgebraicVector& av, const char* filename,
 	
 	bool success = false;
 
-	if(name.rfind(".pvec") != string::npos)
+	if(name.rfind(".ugvb") != string::npos)
+		success = Load_UGVB(av, filename, g_verifyFiles);
+	else if(name.rfind(".pvec") != string::npos)
 		success = Load_PVEC(av, filename, makeConsistent);
 	else if(name.rfind(".vec") != string::npos)
 		success = Load_VEC(av, filename);
@@ -44,3 +63,61 @@ bool LoadVector(AlgebraicVector& av, const char* filename,
 
 	return success;
 }
+
+
+bool SaveVector(const AlgebraicVector& av, const char* filename)
+{
+	string name = filename;
+	if(name.rfind(".ugvb") != string::npos)
+		return Save_UGVB(av, filename);
+	return Save_VEC(av, filename);
+}
+
+
+bool LoadPieces (AlgebraicVector& av, const std::vector<std::string>& files,
+				 bool makeConsistent, PieceLoader loadPiece)
+{
+	const int numThreads = NumThreads();
+
+//	shards are selected by the exact coordinates of nodes, which doesn't
+//	work with a match tolerance
+	if(numThreads > 1 && files.size() > 1 && av.nodes.empty() && MatchTolerance() == 0){
+	//	pieces are loaded ahead into 'pieces' and released once they were merged
+	//	into the shards of 'merger'
+		ShardedMerge merger(numThreads, makeConsistent);
+		vector<ShardedPiece> pieces(files.size());
+
+		const bool success = OrderedPipeline(files.size(), numThreads, 2 * numThreads,
+			[&](size_t i){
+				if(!loadPiece(pieces[i].av, files[i].c_str()))
+					return false;
+				merger.prepare(pieces[i]);
+				return true;
+			},
+			[&](size_t i){
+				merger.merge(pieces[i]);
+				pieces[i] = ShardedPiece();
+			});
+
+		if(success)
+			merger.assemble(av);
+		return success;
+	}
+
+	MergeIndex globIndex;
+	globIndex.init(av);
+
+	vector<AlgebraicVector> pieces(files.size());
+
+	return OrderedPipeline(files.size(), numThreads, 2 * numThreads,
+		[&](size_t i){
+			return loadPiece(pieces[i], files[i].c_str());
+		},
+		[&](size_t i){
+			if(makeConsistent)
+				av.add_vector(pieces[i], globIndex);
+			else
+				av.unite_with_vector(pieces[i], globIndex);
+			AlgebraicVector().swap(pieces[i]);
+		});
+}
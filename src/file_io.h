@@ -9,14 +9,36 @@
 #ifndef __H__ugvec_file_io
 #define __H__ugvec_file_io
 
+#include <string>
+#include <vector>
+
 struct AlgebraicVector;
 
+///	signature of the methods which load a single piece of a parallel vector
+typedef bool (*PieceLoader)(AlgebraicVector& av, const char* filename);
+
 ///	determines Load_... method by filename and fills the 'av' from 'filename'
-/**	If component >= 0, only the specified component will be loaded into 'av'*/
+/**	If component >= 0, only the specified component will be loaded into 'av'.
+ * The checksums of ugvb files are verified if enabled through SetVerifyFiles.*/
 bool LoadVector(AlgebraicVector& av, const char* filename,
 				bool makeConsistent, int component = -1);
 
 
+///	enables the verification of checksums of binary files loaded by LoadVector
+/**	Default is false, since verifying a ugvb file requires a full pass over
+ * its data (see Load_UGVB).*/
+void SetVerifyFiles(bool verify);
+
+///	returns the value set through SetVerifyFiles
+bool VerifyFiles();
+
+
+///	determines Save_... method by filename and writes 'av' to 'filename'
+/**	Files with the extension '.ugvb' are written in the binary ugvb format,
+ * all others in the vec format.*/
+bool SaveVector(const AlgebraicVector& av, const char* filename);
+
+
 /// Loads serial vectors in the vec format
 bool Load_VEC (AlgebraicVector& av, const char* filename);
 
@@ -30,9 +52,51 @@ bool Load_VTU (AlgebraicVector& av, const char* filename);
 bool Load_PVTU (AlgebraicVector& av, const char* filename, bool makeConsistent);
 
 
+///	Loads the serial pieces of a parallel vector and merges them into 'av'
+/**	Pieces are loaded concurrently by NumThreads() threads (see parallel.h).
+ * They are merged into 'av' in the order in which they are specified in
+ * 'files', so the result does not depend on the number of threads.
+ * If more than one thread is used, 'av' is empty and no match tolerance is
+ * set (see SetMatchTolerance), the merge itself is distributed over the
+ * threads through a ShardedMerge.
+ * If makeConsistent is true, values of shared entries are added, otherwise
+ * the value of the first piece which contains an entry is used.*/
+bool LoadPieces (AlgebraicVector& av, const std::vector<std::string>& files,
+				 bool makeConsistent, PieceLoader loadPiece);
+
 
 bool Save_VEC(const AlgebraicVector& av, const char* filename);
 
+
+///	Subtracts the vec file filename2 from filename1 without loading the vectors and prints the min/max of the result
+/**	Both files are read row by row in lock-step, the difference is written
+ * to outFilename and the minimal and maximal values are accumulated on the
+ * fly (see PrintMinMax). The pages of rows which were read are released.
+ *
+ * To associate entries with components, the coordinates of all distinct
+ * node positions are kept in a hash index, which requires 44 to 60 bytes per
+ * position. The index is limited to about 4 million positions (250 MB).
+ *
+ * Returns false and writes no output if the files can't be processed in
+ * lock-step, i.e. if they don't contain the same positions in the same
+ * order, if one of them is malformed or if they contain more distinct
+ * positions than the index can hold. The regular path (Load_VEC and
+ * AlgebraicVector::subtract_vector) has to be used in that case.*/
+bool StreamingDif_VEC(const char* filename1, const char* filename2,
+					  const char* outFilename);
+
+
+///	Loads vectors in the binary ugvb format
+/**	The file is memory-mapped and the arrays of 'av' reference the mapping
+ * until they are modified. The header, the entry counts, the file size and
+ * the node indices are always validated. If 'verifyData' is true, the
+ * checksum of all arrays is validated, too, which requires a full pass over
+ * the file.*/
+bool Load_UGVB (AlgebraicVector& av, const char* filename, bool verifyData = false);
+
+///	Saves vectors in the binary ugvb format
+bool Save_UGVB (const AlgebraicVector& av, const char* filename);
+
 #endif	//__H__ugvec_file_io
 
 
@@ -0,0 +1,365 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+//	The ugvb format stores an AlgebraicVector in binary form:
+//
+//	- UGVBHeader (64 bytes)
+//	- uint64 numEntries[numComps]
+//	- node coordinates: numNodes * 3 doubles (x, y, z)
+//	- for each component: uint32 node index of each entry
+//	- for each component: double value of each entry
+//
+//	Each array starts at an offset which is a multiple of 64 bytes. All
+//	values are stored in the byte order of the writing system, which is
+//	recorded in the header.
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdint.h>
+
+#include "algebraic_vector.h"
+#include "file_io.h"
+#include "mapped_file.h"
+#include "ugvec_base.h"
+
+using namespace std;
+
+static const char		UGVB_MAGIC[4]		= {'U', 'G', 'V', 'B'};
+static const uint32_t	UGVB_VERSION		= 1;
+static const uint32_t	UGVB_BYTE_ORDER		= 0x01020304;
+static const uint64_t	UGVB_ALIGNMENT		= 64;
+
+struct UGVBHeader{
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	byteOrder;		///< UGVB_BYTE_ORDER in the byte order of the writer
+	int32_t		worldDim;
+	uint64_t	numNodes;
+	uint64_t	numComps;
+	uint64_t	fileSize;
+	uint64_t	dataChecksum;	///< checksum of all arrays behind the entry counts
+	uint64_t	headerChecksum;	///< checksum of the header (with headerChecksum = 0) and the entry counts
+	uint64_t	reserved;
+};
+
+static_assert(sizeof(UGVBHeader) == 64, "Unexpected size of UGVBHeader");
+static_assert(sizeof(Node) == 3 * sizeof(double), "Nodes have to consist of 3 doubles");
+
+
+static uint64_t
+AlignUp(uint64_t offset)
+{
+	return (offset + UGVB_ALIGNMENT - 1) / UGVB_ALIGNMENT * UGVB_ALIGNMENT;
+}
+
+
+static void
+SwapBytes(void* p, size_t typeSize, size_t num)
+{
+	char* c = (char*)p;
+	for(size_t i = 0; i < num; ++i, c += typeSize)
+		reverse(c, c + typeSize);
+}
+
+
+static bool
+BigEndianHost()
+{
+	const uint32_t i = 0x01020304;
+	char c;
+	memcpy(&c, &i, 1);
+	return c == 1;
+}
+
+
+///	64 bit checksum of a byte sequence which processes 8 bytes at a time
+/**	Words are interpreted as little endian, so that the checksum doesn't
+ * depend on the byte order of the host.*/
+static uint64_t
+Checksum(const void* data, size_t size, uint64_t seed)
+{
+	static const bool swapWords = BigEndianHost();
+	const uint64_t prime = 0x100000001B3ULL;
+	const unsigned char* p = (const unsigned char*)data;
+	uint64_t h = seed ^ (size * 0x9E3779B97F4A7C15ULL);
+
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8){
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		if(swapWords)
+			SwapBytes(&w, 8, 1);
+		h = (h ^ w) * prime;
+		h ^= h >> 29;
+	}
+
+	for(; i < size; ++i)
+		h = (h ^ p[i]) * prime;
+
+	return h;
+}
+
+
+///	writes 'size' bytes to 'offset' and pads the gap to the current position 'pos' with zeros
+static void
+WriteAt(ofstream& out, uint64_t& pos, uint64_t offset, const void* p, size_t size)
+{
+	const char zeros[UGVB_ALIGNMENT] = {0};
+	out.write(zeros, offset - pos);
+	out.write((const char*)p, size);
+	pos = offset + size;
+}
+
+
+///	offsets of all arrays of a ugvb file
+struct UGVBLayout{
+	UGVBLayout(uint64_t numNodes, const vector<uint64_t>& numEntries)
+	{
+		uint64_t offset = sizeof(UGVBHeader) + numEntries.size() * sizeof(uint64_t);
+		nodesOffset = AlignUp(offset);
+		offset = nodesOffset + numNodes * sizeof(Node);
+
+		nodeIndsOffset.resize(numEntries.size());
+		for(size_t ci = 0; ci < numEntries.size(); ++ci){
+			nodeIndsOffset[ci] = AlignUp(offset);
+			offset = nodeIndsOffset[ci] + numEntries[ci] * sizeof(uint32_t);
+		}
+
+		dataOffset.resize(numEntries.size());
+		for(size_t ci = 0; ci < numEntries.size(); ++ci){
+			dataOffset[ci] = AlignUp(offset);
+			offset = dataOffset[ci] + numEntries[ci] * sizeof(double);
+		}
+
+		fileSize = offset;
+	}
+
+	uint64_t			nodesOffset;
+	vector<uint64_t>	nodeIndsOffset;
+	vector<uint64_t>	dataOffset;
+	uint64_t			fileSize;
+};
+
+
+bool Save_UGVB(const AlgebraicVector& av, const char* filename)
+{
+	LOG("INFO -- saving vector to " << filename << endl);
+
+	vector<uint64_t> numEntries(av.comps.size());
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		if(av.comps[ci].data.size() != av.comps[ci].nodes.size()){
+			LOG("ERROR -- Invalid algebra vector - data and position size does not match."
+				 << " During write to " << filename << endl);
+			return false;
+		}
+		numEntries[ci] = av.comps[ci].data.size();
+	}
+
+	if(av.worldDim < 1 || av.worldDim > 3){
+		LOG("ERROR -- Unsupported world-dimension (" << av.worldDim
+			<< ") during write: " << filename << endl);
+		return false;
+	}
+
+	const UGVBLayout layout(av.nodes.size(), numEntries);
+
+	UGVBHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, UGVB_MAGIC, sizeof(header.magic));
+	header.version = UGVB_VERSION;
+	header.byteOrder = UGVB_BYTE_ORDER;
+	header.worldDim = av.worldDim;
+	header.numNodes = av.nodes.size();
+	header.numComps = av.comps.size();
+	header.fileSize = layout.fileSize;
+
+//	the data checksum chains the checksums of all arrays in file order
+	uint64_t dataChecksum = Checksum(av.nodes.data(), av.nodes.size() * sizeof(Node), 0);
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		dataChecksum = Checksum(av.comps[ci].nodes.data(), numEntries[ci] * sizeof(uint32_t), dataChecksum);
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		dataChecksum = Checksum(av.comps[ci].data.data(), numEntries[ci] * sizeof(double), dataChecksum);
+	header.dataChecksum = dataChecksum;
+
+	header.headerChecksum = Checksum(numEntries.data(), numEntries.size() * sizeof(uint64_t),
+									 Checksum(&header, sizeof(header), 0));
+
+	ofstream out(filename, ios::binary);
+	if(!out){
+		LOG("ERROR -- File can not be opened for write: " << filename << endl);
+		return false;
+	}
+
+	uint64_t pos = 0;
+	WriteAt(out, pos, 0, &header, sizeof(header));
+	WriteAt(out, pos, pos, numEntries.data(), numEntries.size() * sizeof(uint64_t));
+	WriteAt(out, pos, layout.nodesOffset, av.nodes.data(), av.nodes.size() * sizeof(Node));
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		WriteAt(out, pos, layout.nodeIndsOffset[ci], av.comps[ci].nodes.data(), numEntries[ci] * sizeof(uint32_t));
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		WriteAt(out, pos, layout.dataOffset[ci], av.comps[ci].data.data(), numEntries[ci] * sizeof(double));
+
+	if(!out){
+		LOG("ERROR -- Failed to write to " << filename << endl);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool Load_UGVB(AlgebraicVector& av, const char* filename, bool verifyData)
+{
+	LOG("INFO -- loading vector from " << filename << endl);
+
+	shared_ptr<MappedFile> file(new MappedFile);
+	if(!file->open(filename)){
+		LOG("ERROR -- File not found: " << filename << endl);
+		return false;
+	}
+
+	const char* content = file->data();
+	const uint64_t fileSize = file->size();
+
+	UGVBHeader header;
+	if(fileSize < sizeof(header)){
+		LOG("ERROR -- File is too small to be a ugvb file: " << filename << endl);
+		return false;
+	}
+
+	memcpy(&header, content, sizeof(header));
+	if(memcmp(header.magic, UGVB_MAGIC, sizeof(header.magic)) != 0){
+		LOG("ERROR -- Not a ugvb file: " << filename << endl);
+		return false;
+	}
+
+	const bool swapBytes = (header.byteOrder != UGVB_BYTE_ORDER);
+	if(swapBytes){
+		SwapBytes(&header.version, sizeof(uint32_t), 2);
+		SwapBytes(&header.worldDim, sizeof(int32_t), 1);
+		SwapBytes(&header.numNodes, sizeof(uint64_t), 6);
+		if(header.byteOrder != UGVB_BYTE_ORDER){
+			LOG("ERROR -- Unknown byte order in " << filename << endl);
+			return false;
+		}
+	}
+
+	if(header.version != UGVB_VERSION){
+		LOG("ERROR -- Unsupported ugvb version " << header.version << " in " << filename << endl);
+		return false;
+	}
+
+	if(header.worldDim < 1 || header.worldDim > 3){
+		LOG("ERROR -- Unsupported world-dimension (" << header.worldDim
+			 << ") during read: " << filename << endl);
+		return false;
+	}
+
+	if(header.numNodes >= (uint64_t)numeric_limits<uint>::max()
+	   || header.numComps > (fileSize - sizeof(header)) / sizeof(uint64_t))
+	{
+		LOG("ERROR -- Corrupt ugvb header in " << filename << endl);
+		return false;
+	}
+
+	vector<uint64_t> numEntries(header.numComps);
+	if(!numEntries.empty())
+		memcpy(numEntries.data(), content + sizeof(header), numEntries.size() * sizeof(uint64_t));
+	if(swapBytes)
+		SwapBytes(numEntries.data(), sizeof(uint64_t), numEntries.size());
+
+//	validate the header checksum
+	{
+		UGVBHeader rawHeader;
+		memcpy(&rawHeader, content, sizeof(rawHeader));
+		rawHeader.headerChecksum = 0;
+		const uint64_t checksum = Checksum(content + sizeof(header), numEntries.size() * sizeof(uint64_t),
+										   Checksum(&rawHeader, sizeof(rawHeader), 0));
+		if(checksum != header.headerChecksum){
+			LOG("ERROR -- Header checksum mismatch in " << filename << endl);
+			return false;
+		}
+	}
+
+	for(size_t ci = 0; ci < numEntries.size(); ++ci){
+		if(numEntries[ci] > fileSize){
+			LOG("ERROR -- Corrupt ugvb header in " << filename << endl);
+			return false;
+		}
+	}
+
+	const UGVBLayout layout(header.numNodes, numEntries);
+	if(layout.fileSize != header.fileSize || layout.fileSize > fileSize){
+		LOG("ERROR -- Unexpected size of ugvb file " << filename << endl);
+		return false;
+	}
+
+	if(verifyData){
+		uint64_t dataChecksum = Checksum(content + layout.nodesOffset, header.numNodes * sizeof(Node), 0);
+		for(size_t ci = 0; ci < numEntries.size(); ++ci)
+			dataChecksum = Checksum(content + layout.nodeIndsOffset[ci], numEntries[ci] * sizeof(uint32_t), dataChecksum);
+		for(size_t ci = 0; ci < numEntries.size(); ++ci)
+			dataChecksum = Checksum(content + layout.dataOffset[ci], numEntries[ci] * sizeof(double), dataChecksum);
+
+		if(dataChecksum != header.dataChecksum){
+			LOG("ERROR -- Data checksum mismatch in " << filename << endl);
+			return false;
+		}
+	}
+
+	av.clear();
+	av.worldDim = header.worldDim;
+	av.comps.resize(numEntries.size());
+
+	if(!swapBytes){
+	//	reference the arrays in the mapped file. 'file' stays alive as long
+	//	as one of the arrays references it.
+		av.nodes.set_view((const Node*)(content + layout.nodesOffset), header.numNodes, file);
+		for(size_t ci = 0; ci < numEntries.size(); ++ci){
+			av.comps[ci].nodes.set_view((const uint*)(content + layout.nodeIndsOffset[ci]),
+										numEntries[ci], file);
+			av.comps[ci].data.set_view((const number*)(content + layout.dataOffset[ci]),
+									   numEntries[ci], file);
+		}
+	}
+	else{
+		av.nodes.resize(header.numNodes);
+		memcpy(av.nodes.data(), content + layout.nodesOffset, header.numNodes * sizeof(Node));
+		SwapBytes(av.nodes.data(), sizeof(double), 3 * header.numNodes);
+		for(size_t ci = 0; ci < numEntries.size(); ++ci){
+			Component& comp = av.comps[ci];
+			comp.nodes.resize(numEntries[ci]);
+			memcpy(comp.nodes.data(), content + layout.nodeIndsOffset[ci], numEntries[ci] * sizeof(uint32_t));
+			SwapBytes(comp.nodes.data(), sizeof(uint32_t), numEntries[ci]);
+			comp.data.resize(numEntries[ci]);
+			memcpy(comp.data.data(), content + layout.dataOffset[ci], numEntries[ci] * sizeof(double));
+			SwapBytes(comp.data.data(), sizeof(double), numEntries[ci]);
+		}
+	}
+
+//	node indices are always validated, since invalid indices would lead to
+//	out of bounds accesses in all operations on 'av'.
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const Array<uint>& compNodes = av.comps[ci].nodes;
+		const uint* inds = compNodes.data();
+		uint maxInd = 0;
+		for(size_t i = 0; i < compNodes.size(); ++i)
+			maxInd = max(maxInd, inds[i]);
+		if(!compNodes.empty() && maxInd >= header.numNodes){
+			LOG("ERROR -- Bad node index in " << filename << endl);
+			av.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
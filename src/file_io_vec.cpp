@@ -7,6 +7,7 @@
 // with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
@@ -15,129 +16,213 @@
 
 #include "algebraic_vector.h"
 #include "file_io.h"
+#include "mapped_file.h"
+#include "merge_index.h"
+#include "text_parsing.h"
+#include "text_writer.h"
+#include "ugvec_base.h"
 #include "vec_tools.h"
 
 using namespace std;
 
+///	parses the worldDim coordinates of a node. Returns NULL on failure.
+static const char*
+ParseNode(const char* cur, const char* end, int worldDim, Node& p)
+{
+	for(int d = 0; d < worldDim; ++d){
+		cur = SkipSpaces(cur, end);
+		const char* next = ParseDouble(cur, end, p.coord[d]);
+		if(next == cur)
+			return NULL;
+		cur = next;
+	}
+	return cur;
+}
+
+
+///	parses the numbers of a row 'ind ind value [value ...]' of the data section of a vec file
+/**	The row ends at lineEnd. Brackets are ignored, tokens which are no
+ * numbers are skipped and tokens containing 'n' or 'N' are counted as nan.*/
+static void
+ParseValueRow(const char* cur, const char* lineEnd, vector<double>& values,
+			  size_t& numNANs)
+{
+	values.clear();
+
+	while(cur < lineEnd){
+		const char c = *cur;
+		if(IsSpace(c) || c == '[' || c == ']'){
+			++cur;
+			continue;
+		}
+
+		const char* tokenEnd = cur;
+		while(tokenEnd < lineEnd && !IsSpace(*tokenEnd))
+			++tokenEnd;
+
+		for(const char* t = cur; t < tokenEnd; ++t){
+			if(*t == 'n' || *t == 'N'){
+				++numNANs;
+				break;
+			}
+		}
+
+		double val;
+		const char* next = ParseDouble(cur, tokenEnd, val);
+		if(next == cur){
+		//	skip tokens which are no numbers
+			cur = tokenEnd;
+			continue;
+		}
+
+		values.push_back(val);
+		cur = next;
+	}
+}
+
+
 bool Load_VEC (AlgebraicVector& av, const char* filename)
 {
-	cout << "INFO -- loading vector from " << filename << endl;
+	LOG("INFO -- loading vector from " << filename << endl);
 	
-	string line;
-	ifstream in(filename);
-	if(!in){
-		cout << "ERROR -- File not found: " << filename << endl;
+	MappedFile file;
+	if(!file.open(filename)){
+		LOG("ERROR -- File not found: " << filename << endl);
 		return false;
 	}
-	
-	int blockSize;
-	in >> blockSize;
-	in >> av.worldDim;
-	
-	int numEntries;
-	in >> numEntries;
-	av.positions.clear();
-	av.positions.reserve(numEntries);
-	
-	std::map<Position, size_t> posMap;
-
-
-	for(int i = 0; i < numEntries; ++i){
-		Position p;
-		switch(av.worldDim){
-			case 1:	in >> p.x; break;
-			case 2:	in >> p.x >> p.y; break;
-			case 3:	in >> p.x >> p.y >> p.z; break;
-			default:
-				cout << "ERROR -- Unsupported world-dimension (" << av.worldDim
-					 << ") during write: " << filename << endl;
-				return false;
+
+//	the file is parsed in place
+	const char* cur = file.data();
+	const char* const end = file.data() + file.size();
+
+	long header[3];
+	for(int i = 0; i < 3; ++i){
+		cur = SkipSpaces(cur, end);
+		const char* next = ParseInt(cur, end, header[i]);
+		if(next == cur){
+			LOG("ERROR -- Bad header in file: " << filename << endl);
+			return false;
 		}
+		cur = next;
+	}
 
-	//	during the lookup p.ci should always be 0
-		size_t& ci = posMap[p];
-		p.ci = ci;
-		++ci;
-		av.positions.push_back(p);
+	av.worldDim = (int)header[1];
+	const long numEntries = header[2];
+
+	if(av.worldDim < 1 || av.worldDim > 3){
+		LOG("ERROR -- Unsupported world-dimension (" << av.worldDim
+			 << ") during read: " << filename << endl);
+		return false;
+	}
+
+	if(numEntries < 0){
+		LOG("ERROR -- Bad number of entries in file: " << filename << endl);
+		return false;
 	}
-	
-//	get the rest of the last line
-	getline(in, line);
 
-//	read some arbitrary value which separates positions and connections
-	getline(in, line);
+	av.nodes.clear();
+	av.comps.clear();
 
-//	read data values
-	av.data.clear();
-	av.data.resize(numEntries, 0);
+//	Each node is stored only once. If a node occurs several times, its
+//	n-th occurrence is associated with component n.
+//	The header isn't trusted for reservations. Each entry requires a row in
+//	the data section ('i i v', at least 5 characters) and at least one
+//	character per coordinate.
+	const size_t maxNumEntries = file.size() / (av.worldDim + 5);
+	const size_t numReserved = min((size_t)numEntries, maxNumEntries);
 
-	size_t numNANs = 0;
-	vector<double> values;
+	NodeHashIndex nodeIndex;
+	nodeIndex.reserve(numReserved);
+	vector<uint> numOccurrences;
 
-	for(int i = 0; i < numEntries; ++i){
-		getline(in, line);
-		size_t start = 0;
-		values.clear();
-		while(start < line.size()) {
-			const char cur = line[start];
-			if(cur == ' '){
-				++start;
-				continue;
-			}
-			else if (cur == '[' || cur == ']'){
-				++start;
-				continue;
-			}
-			else{
-				size_t end = line.find(' ', start);
-				if(end == string::npos)
-					end = line.size();
-				const size_t num = end - start;
-				if((line.find("n", start, num) != string::npos)
-					|| (line.find("N", start, num) != string::npos))
-				{
-					++numNANs;
-					continue;
-				}
+//	for each row the component and the index of the entry in that component
+	vector<int> rowCI;
+	vector<uint> rowEntry;
+	rowCI.reserve(numReserved);
+	rowEntry.reserve(numReserved);
 
-				char* endPtr;
-				const char* startPtr = line.c_str() + start;
-				values.push_back(strtod(startPtr, &endPtr));
-				start += endPtr - startPtr;
-			}
+	for(long i = 0; i < numEntries; ++i){
+		Node p;
+		cur = ParseNode(cur, end, av.worldDim, p);
+		if(!cur){
+			LOG("ERROR -- Bad coordinate in row " << i << ". In File: "
+				<< filename << endl);
+			return false;
+		}
+
+		const uint newInd = (uint)av.nodes.size();
+		const uint node = nodeIndex.find_or_insert(p, newInd, av.nodes);
+		if(node == newInd){
+			av.add_node(p);
+			numOccurrences.push_back(0);
 		}
 
+		const int ci = numOccurrences[node]++;
+		if(ci >= av.num_components())
+			av.comps.resize(ci + 1);
+
+		Component& comp = av.comps[ci];
+		rowCI.push_back(ci);
+		rowEntry.push_back((uint)comp.nodes.size());
+		comp.nodes.push_back(node);
+	}
+
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		av.comps[ci].data.resize(av.comps[ci].nodes.size(), 0);
+	
+//	skip the rest of the last line
+	cur = SkipLine(cur, end);
+
+//	skip some arbitrary value which separates positions and connections
+	cur = SkipLine(cur, end);
+
+//	read data values. Each row has the form 'ind ind value [value ...]'.
+//	Brackets are ignored and tokens containing 'n' or 'N' are counted as nan.
+	size_t numNANs = 0;
+	vector<double> values;
+
+	for(long i = 0; i < numEntries; ++i){
+		const char* lineEnd = FindLineEnd(cur, end);
+		const char* lineStart = cur;
+		ParseValueRow(cur, lineEnd, values, numNANs);
+		cur = (lineEnd < end) ? lineEnd + 1 : end;
+
 		if(values.size() < 3){
-			cout << "ERROR -- Not enough values specified in connection. In File: "
-				<< filename << endl;
-			cout << "line read: " << line << endl;
+			LOG("ERROR -- Not enough values specified in connection. In File: "
+				<< filename << endl
+				<< "line read: " << string(lineStart, lineEnd) << endl);
 			continue;
 		}
 
-		const int ind1 = static_cast<int>(values[0]);
-		const int ind2 = static_cast<int>(values[1]);
+		const long ind1 = static_cast<long>(values[0]);
+		const long ind2 = static_cast<long>(values[1]);
 
 		if(ind1 != ind2){
-			cout << "ERROR -- Only connections to self are supported! In File: "
-				 << filename << endl;
+			LOG("ERROR -- Only connections to self are supported! In File: "
+				 << filename << endl);
 		}
 		
 		if((ind1 < 0) || (ind1 >= numEntries)){
-			cout << "ERROR -- Bad index: " << ind1 << ". In File: " << filename << endl;
+			LOG("ERROR -- Bad index: " << ind1 << ". In File: " << filename << endl);
+			continue;
 		}
 
-		av.data[ind1] = values[2];
+		Component& comp = av.comps[rowCI[ind1]];
+		comp.data[rowEntry[ind1]] = values[2];
 
+	//	additional values in a row are associated with additional components
+		const uint node = comp.nodes[rowEntry[ind1]];
 		for(size_t i = 3; i < values.size(); ++i){
-			Position p = av.positions[ind1];
-			p.ci = i-2;
-			av.positions.push_back(p);
-			av.data.push_back(values[i]);
+			const size_t ci = i - 2;
+			if(ci >= av.comps.size())
+				av.comps.resize(ci + 1);
+			av.comps[ci].nodes.push_back(node);
+			av.comps[ci].data.push_back(values[i]);
 		}
 	}
 
 	if(numNANs > 0)
-		cout << "  -> WARNING: vector contains " << numNANs << " 'nan' entries!" << endl;
+		LOG("  -> WARNING: vector contains " << numNANs << " 'nan' entries!" << endl);
 	
 	return true;
 }
@@ -145,7 +230,7 @@ bool Load_VEC (AlgebraicVector& av, const char* filename)
 
 bool Load_PVEC(AlgebraicVector& av, const char* filename, bool makeConsistent)
 {
-	cout << "INFO -- loading parallel vector from " << filename << endl;
+	LOG("INFO -- loading parallel vector from " << filename << endl);
 	
 //	extract the path from filename
 	string strFilename = filename;
@@ -160,89 +245,446 @@ bool Load_PVEC(AlgebraicVector& av, const char* filename, bool makeConsistent)
 //	load the parallel file
 	ifstream inParallel(filename);
 	if(!inParallel){
-		cout << "ERROR -- File not found: " << filename << endl;
+		LOG("ERROR -- File not found: " << filename << endl);
 		return false;
 	}
 	
 	int numFiles;
 	inParallel >> numFiles;
-	
-	bool useGlobPosMap = false;
-	#ifdef PARALLEL_LOAD_SPEEDUP
-		useGlobPosMap = (numFiles > 1);
-	#endif
-
-	std::map<Position, size_t> globPosMap;
 
+	vector<string> files;
 	for(int i = 0; i < numFiles; ++i){
-        //char serialFile[512];
-        //inParallel.getline(serialFile, 511);
         string serialFile;
         inParallel >> serialFile;
-        string tfilename = path + serialFile;
-        AlgebraicVector tmpAv;
-        if(Load_VEC(tmpAv, tfilename.c_str())){
-        	if(useGlobPosMap){
-        		cout << "  using parallel load speedup.\n";
-				if(makeConsistent)
-					av.add_vector(tmpAv, globPosMap);
-				else
-					av.unite_with_vector(tmpAv, globPosMap);
-			}
-			else{
-				if(makeConsistent)
-					av.add_vector(tmpAv);
-				else
-					av.unite_with_vector(tmpAv);
-			}
-        }
-        else
-            return false;
+        files.push_back(path + serialFile);
     }
 
-	return true;
+	return LoadPieces(av, files, makeConsistent, &Load_VEC);
+}
+
+
+///	appends the coordinates of a node as a row of a vec file
+static void AppendNodeRow(TextBuffer& buf, const Node& n, int worldDim)
+{
+	buf.append_number(n.x);
+	for(int d = 1; d < worldDim; ++d){
+		buf.append(' ');
+		buf.append_number(n.coord[d]);
+	}
+	buf.append('\n');
+}
+
+
+///	appends the row 'ind ind value' of the data section of a vec file
+static void AppendValueRow(TextBuffer& buf, size_t ind, number val)
+{
+	buf.append_uint(ind);
+	buf.append(' ');
+	buf.append_uint(ind);
+	buf.append(' ');
+	buf.append_number(val);
+	buf.append('\n');
 }
 
 
+//	formatted output is written to the file whenever a buffer exceeds this size
+static const size_t writeBlockSize = 1 << 20;
+
+///	number of entries which are formatted together by one thread in Save_VEC
+static const size_t writeChunkSize = 1 << 15;
+
+
 bool Save_VEC(const AlgebraicVector& av, const char* filename)
 {
-	cout << "INFO -- saving vector to " << filename << endl;
+	LOG("INFO -- saving vector to " << filename << endl);
 	
-	if(av.data.size() != av.positions.size()){
-		cout << "ERROR -- Invalid algebra vector - data and position size does not match."
-			 << " During write to " << filename << endl;
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		if(av.comps[ci].data.size() != av.comps[ci].nodes.size()){
+			LOG("ERROR -- Invalid algebra vector - data and position size does not match."
+				<< " During write to " << filename << endl);
+			return false;
+		}
+	}
+
+	if(av.worldDim < 1 || av.worldDim > 3){
+		LOG("ERROR -- Unsupported world-dimension (" << av.worldDim
+			<< ") during write: " << filename << endl);
 		return false;
 	}
 	
-	ofstream out(filename);
-	if(!out){
-		cout << "ERROR -- File can not be opened for write: " << filename << endl;
+	OutputFile out;
+	if(!out.open(filename)){
+		LOG("ERROR -- File can not be opened for write: " << filename << endl);
+		return false;
+	}
+
+	TextBuffer buf;
+	buf.append("1\n");
+	buf.append_int(av.worldDim);
+	buf.append('\n');
+	buf.append_uint(av.num_entries());
+	buf.append('\n');
+	out.write(buf);
+
+//	entries of all components are written one after the other. Since each
+//	component repeats the positions of its nodes, Load_VEC will recognize them.
+//	The global entry range is split into chunks which are formatted
+//	concurrently. Chunks [0, numChunks) hold coordinate rows,
+//	chunks [numChunks, 2*numChunks) the associated value rows.
+	vector<size_t> compOffsets(av.comps.size() + 1, 0);
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		compOffsets[ci + 1] = compOffsets[ci] + av.comps[ci].data.size();
+
+	const size_t numEntries = compOffsets.back();
+	const size_t numChunks = (numEntries + writeChunkSize - 1) / writeChunkSize;
+
+	bool success = WriteChunks(out, 2 * numChunks,
+		[&](size_t chunk, TextBuffer& chunkBuf){
+			const bool values = (chunk >= numChunks);
+			const size_t first = (chunk % numChunks) * writeChunkSize;
+			const size_t last = min(first + writeChunkSize, numEntries);
+
+			chunkBuf.reserve((last - first) * 64);
+			if(values && first == 0)
+				chunkBuf.append("1\n");
+
+			size_t ci = upper_bound(compOffsets.begin(), compOffsets.end(), first)
+						- compOffsets.begin() - 1;
+			for(size_t ind = first; ind < last; ++ci){
+				const Component& comp = av.comps[ci];
+				const size_t compEnd = min(last, compOffsets[ci + 1]);
+				for(size_t i = ind - compOffsets[ci]; ind < compEnd; ++i, ++ind){
+					if(values)
+						AppendValueRow(chunkBuf, ind, comp.data[i]);
+					else
+						AppendNodeRow(chunkBuf, av.nodes[comp.nodes[i]], av.worldDim);
+				}
+			}
+		});
+
+	if(numChunks == 0){
+		buf.clear();
+		buf.append("1\n");
+		success = out.write(buf);
+	}
+
+	if(!out.close() || !success){
+		LOG("ERROR -- Writing to " << filename << " failed." << endl);
 		return false;
 	}
 	
-	out << int(1) << endl;
-	out << av.worldDim << endl;
-	out << av.positions.size() << endl;
-	
-	for(size_t i = 0; i < av.positions.size(); ++i){
-		switch(av.worldDim){
-			case 1:	out << av.positions[i].x << endl; break;
-			case 2:	out << av.positions[i].x << " " << av.positions[i].y << endl; break;
-			case 3:	out << av.positions[i].x << " " << av.positions[i].y << " " << av.positions[i].z << endl; break;
-			default:
-				cout << "ERROR -- Unsupported world-dimension (" << av.worldDim
-					 << ") during write: " << filename << endl;
+	return true;
+}
+
+
+namespace{
+
+///	reads the rows of a memory-mapped vec file sequentially
+/**	A row consists of the coordinates of an entry and the associated row
+ * 'ind ind value [value ...]' of the data section. Both sections are
+ * traversed at the same time, so that no per-entry data has to be stored.
+ * To locate the data section, 'open' scans the coordinate section once in
+ * advance. Pages are released behind both scans (see release_read_rows).*/
+class VecRowReader{
+	public:
+		VecRowReader() : m_worldDim(0), m_numEntries(0), m_row(0), m_numNANs(0)	{}
+
+	///	opens the file, reads its header and locates the data section
+		bool open(const char* filename)
+		{
+			if(!m_file.open(filename)){
+				LOG("ERROR -- File not found: " << filename << endl);
+				return false;
+			}
+
+			m_begin = m_file.data();
+			m_end = m_begin + m_file.size();
+
+			const char* cur = m_begin;
+			long header[3];
+			for(int i = 0; i < 3; ++i){
+				cur = SkipSpaces(cur, m_end);
+				const char* next = ParseInt(cur, m_end, header[i]);
+				if(next == cur){
+					LOG("ERROR -- Bad header in file: " << filename << endl);
+					return false;
+				}
+				cur = next;
+			}
+
+			m_worldDim = (int)header[1];
+			m_numEntries = header[2];
+			if(m_worldDim < 1 || m_worldDim > 3 || m_numEntries < 0){
+				LOG("ERROR -- Bad header in file: " << filename << endl);
+				return false;
+			}
+
+		//	the data section starts behind the coordinate rows and the separator row
+			m_coordCur = SkipLine(cur, m_end);
+			m_valCur = m_coordCur;
+			const char* released = m_coordCur;
+			for(long i = 0; i <= m_numEntries; ++i){
+				m_valCur = SkipLine(m_valCur, m_end);
+				if((i & 0xFFFF) == 0xFFFF){
+					m_file.release(released, m_valCur);
+					released = m_valCur;
+				}
+			}
+			m_file.release(released, m_valCur);
+
+			m_coordReleased = m_coordCur;
+			m_valReleased = m_valCur;
+			return true;
+		}
+
+		int world_dim() const			{return m_worldDim;}
+		long num_entries() const		{return m_numEntries;}
+		size_t num_nans() const			{return m_numNANs;}
+
+	///	reads the next row. Returns false if the row is malformed or its indices don't match the row.
+		bool read_row(Node& p, vector<double>& values)
+		{
+			const char* next = ParseNode(m_coordCur, m_end, m_worldDim, p);
+			if(!next)
+				return false;
+			m_coordCur = next;
+
+			const char* lineEnd = FindLineEnd(m_valCur, m_end);
+			ParseValueRow(m_valCur, lineEnd, values, m_numNANs);
+			m_valCur = (lineEnd < m_end) ? lineEnd + 1 : m_end;
+
+			if(values.size() < 3 || values[0] != m_row || values[1] != m_row)
 				return false;
+
+			++m_row;
+			return true;
+		}
+
+	///	releases the pages of all rows which were read so far
+		void release_read_rows()
+		{
+			m_file.release(m_coordReleased, m_coordCur);
+			m_file.release(m_valReleased, m_valCur);
+			m_coordReleased = m_coordCur;
+			m_valReleased = m_valCur;
+		}
+
+	private:
+		MappedFile	m_file;
+		const char*	m_begin;
+		const char*	m_end;
+		const char*	m_coordCur;
+		const char*	m_valCur;
+		const char*	m_coordReleased;
+		const char*	m_valReleased;
+		int			m_worldDim;
+		long		m_numEntries;
+		long		m_row;
+		size_t		m_numNANs;
+};
+
+
+///	minimum and maximum of a component
+/**	Entries are compared by their value and by 'key', which reflects the order
+ * of the entries in the component after Load_VEC. So the same extremum as
+ * in PrintMinMax is found for equal values.*/
+struct MinMaxAccumulator{
+	MinMaxAccumulator() :
+		num(0), firstKey(0),
+		minVal(numeric_limits<number>::max()), maxVal(-numeric_limits<number>::max()),
+		minSet(false), maxSet(false), minKey(0), maxKey(0)	{}
+
+	void add(number val, uint64_t key, const Position& pos)
+	{
+		if(num == 0 || key < firstKey){
+			firstKey = key;
+			firstPos = pos;
+		}
+		++num;
+
+		if(val < minVal || (minSet && val == minVal && key < minKey)){
+			minVal = val;
+			minKey = key;
+			minPos = pos;
+			minSet = true;
+		}
+
+		if(val > maxVal || (maxSet && val == maxVal && key < maxKey)){
+			maxVal = val;
+			maxKey = key;
+			maxPos = pos;
+			maxSet = true;
 		}
 	}
-	
-	out << int(1) << endl;
-	
-	for(size_t i = 0; i < av.data.size(); ++i){
-		out << int(i) << " " << int(i) << " "
-			<< setprecision(numeric_limits<number>::digits10 + 1)
-			<< av.data[i] << endl;
+
+	size_t		num;
+	uint64_t	firstKey;
+	Position	firstPos;
+	number		minVal;
+	number		maxVal;
+	bool		minSet;
+	bool		maxSet;
+	uint64_t	minKey;
+	uint64_t	maxKey;
+	Position	minPos;
+	Position	maxPos;
+};
+
+}//	end of anonymous namespace
+
+
+///	maximal number of distinct positions which StreamingDif_VEC keeps in memory
+/**	The node index requires 44 to 60 bytes per position, i.e. at most about
+ * 250 MB for this number of positions.*/
+static const size_t streamingDifMaxNodes = 1 << 22;
+
+bool StreamingDif_VEC(const char* filename1, const char* filename2,
+					  const char* outFilename)
+{
+	LOG("INFO -- streaming dif of " << filename1 << " and " << filename2
+		<< " to " << outFilename << endl);
+
+	VecRowReader in1, in2;
+	if(!in1.open(filename1) || !in2.open(filename2))
+		return false;
+
+	if(in1.world_dim() != in2.world_dim() || in1.num_entries() != in2.num_entries())
+		return false;
+
+	const int worldDim = in1.world_dim();
+	const long numEntries = in1.num_entries();
+
+//	coordinates are written to the out-file directly, data rows to a temporary
+//	file, which is appended to the out-file in the end.
+	const string tmpFilename = string(outFilename) + ".tmp";
+	OutputFile out, outData;
+	if(!out.open(outFilename) || !outData.open(tmpFilename.c_str())){
+		LOG("ERROR -- File can not be opened for write: " << outFilename << endl);
+		return false;
 	}
-	
+
+	TextBuffer buf, dataBuf;
+	buf.reserve(writeBlockSize + 256);
+	dataBuf.reserve(writeBlockSize + 256);
+	buf.append("1\n");
+	buf.append_int(worldDim);
+	buf.append('\n');
+	buf.append_int(numEntries);
+	buf.append('\n');
+
+//	Entries are associated with components in the same way as in Load_VEC:
+//	the n-th occurrence of a node belongs to component n and additional
+//	values in a data row belong to components 1, 2, ...
+//	The coordinates of all distinct nodes are kept in memory, so that probes
+//	of the index don't touch pages of the files which were already released.
+//	To bound the memory usage, the streaming dif is abandoned if there are
+//	more than streamingDifMaxNodes distinct nodes.
+	NodeHashIndex nodeIndex;
+	vector<Node> nodes;
+	vector<uint> numOccurrences;
+	vector<MinMaxAccumulator> minMax;
+
+	Node p1, p2;
+	vector<double> values1, values2;
+	const long chunkSize = 1 << 16;
+	bool success = true;
+
+	for(long row = 0; row < numEntries; ++row){
+		if(!in1.read_row(p1, values1) || !in2.read_row(p2, values2)
+		   || !NodeHashIndex::same(p1, p2) || values1.size() != values2.size())
+		{
+			success = false;
+			break;
+		}
+
+		const uint newInd = (uint)nodes.size();
+		const uint node = nodeIndex.find_or_insert(p1, newInd, nodes);
+		if(node == newInd){
+			if(nodes.size() == streamingDifMaxNodes){
+				LOG("INFO -- more than " << streamingDifMaxNodes
+					<< " distinct positions. Aborting streaming dif." << endl);
+				success = false;
+				break;
+			}
+			nodes.push_back(p1);
+			numOccurrences.push_back(0);
+		}
+
+		AppendNodeRow(buf, p1, worldDim);
+
+		dataBuf.append_int(row);
+		dataBuf.append(' ');
+		dataBuf.append_int(row);
+		const size_t numVals = values1.size() - 2;
+		for(size_t i = 0; i < numVals; ++i){
+		//	computed like subtract_vector to get identical results (including the sign of 0)
+			const number d = -(values2[i + 2] - values1[i + 2]);
+			dataBuf.append(' ');
+			dataBuf.append_number(d);
+
+			const size_t ci = (i == 0) ? numOccurrences[node]++ : i;
+			if(ci >= minMax.size())
+				minMax.resize(ci + 1);
+			const uint64_t key = (i == 0) ? (uint64_t)row : (uint64_t)(numEntries + row);
+			minMax[ci].add(d, key, Position(p1, (int)ci));
+		}
+		dataBuf.append('\n');
+
+		if(buf.size() > writeBlockSize){
+			out.write(buf);
+			buf.clear();
+		}
+		if(dataBuf.size() > writeBlockSize){
+			outData.write(dataBuf);
+			dataBuf.clear();
+		}
+
+		if(row % chunkSize == chunkSize - 1){
+			in1.release_read_rows();
+			in2.release_read_rows();
+		}
+	}
+
+	outData.write(dataBuf);
+	bool written = outData.close();
+
+	if(success){
+		buf.append("1\n");
+		out.write(buf);
+
+		MappedFile inData;
+		if(numEntries > 0){
+			written = written && inData.open(tmpFilename.c_str())
+					  && out.write(inData.data(), inData.size());
+		}
+	}
+
+	written = out.close() && written;
+	remove(tmpFilename.c_str());
+
+	if(success && !written){
+		LOG("ERROR -- Writing to " << outFilename << " failed" << endl);
+		success = false;
+	}
+
+	if(!success){
+		remove(outFilename);
+		return false;
+	}
+
+	if(in1.num_nans() > 0)
+		LOG("  -> WARNING: " << filename1 << " contains " << in1.num_nans() << " 'nan' entries!" << endl);
+	if(in2.num_nans() > 0)
+		LOG("  -> WARNING: " << filename2 << " contains " << in2.num_nans() << " 'nan' entries!" << endl);
+
+	for(size_t ci = 0; ci < minMax.size(); ++ci){
+		const MinMaxAccumulator& m = minMax[ci];
+		if(m.num == 0)
+			continue;
+		PrintComponentMinMax((int)ci,
+							 m.minVal, m.minSet ? m.minPos : m.firstPos,
+							 m.maxVal, m.maxSet ? m.maxPos : m.firstPos);
+	}
+
 	return true;
-}
\ No newline at end of file
+}
@@ -20,9 +20,18 @@
 #include "algebraic_vector.h"
 #include "base64.h"
 #include "file_io.h"
+#include "mapped_file.h"
+#include "merge_index.h"
+#include "parallel.h"
+#include "text_parsing.h"
+#include "ugvec_base.h"
 #include "vec_tools.h"
 #include "rapidxml.hpp"
 
+#ifdef UGVEC_WITH_ZLIB
+	#include <zlib.h>
+#endif
+
 using ::int8_t;
 using ::int16_t;
 using ::int32_t;
@@ -65,23 +74,6 @@ int BigEndianSystem()
     return bint.c[0] == 1; 
 }
 
-void ByteSwap (char* p, int len)
-{
-	for(int i = 0; i + 1 < len; ++i){
-		const char t = p[i];
-		const int i2 = len - i;
-		p[i] = p[i2];
-		p[i2] = t;
-	}
-}
-
-void SwapArrayEndianess (char* p, size_t size, int typeLen)
-{
-	for(size_t i = 0; i < size; i+= typeLen){
-		ByteSwap (p + i, typeLen);
-	}
-}
-
 ///	Returns the value of the first attribute with the given name.
 /** If no such attribute exists, the method throws.
  * The method compares lower-case versions of involved names.*/
@@ -107,109 +99,450 @@ GetAttribVal (xml_node<>* node, const char* attribName, const char* defValue)
 }
 
 
+///	destinations of the components of a DataArray
+/**	The j-th value of component ic is written to ptrs[ic][j * stride].
+ * Components whose pointer is NULL are skipped.*/
+struct ComponentTargets{
+	vector<number*>	ptrs;
+	size_t			stride;
+};
+
+
+///	converts 'num' values of type T at 'src' to 'number' and writes them to 'targets'
+/**	'first' is the index of the first value in the whole DataArray.*/
 template <class T>
 static void
-ReadDataArrayBINARY(std::vector<T>& dataOut,
-					rapidxml::xml_node<>* dataNode,
-					bool bigEndian,
-					bool clearData)
+ScatterValues(const char* src, size_t num, size_t first, bool swapBytes,
+			  const ComponentTargets& targets)
 {
-	using namespace std;
-
-	if(clearData)
-		dataOut.clear();
+	const size_t numComps = targets.ptrs.size();
+	size_t ic = first % numComps;
+	size_t tuple = first / numComps;
+
+	for(size_t i = 0; i < num; ++i, src += sizeof(T)){
+		T val;
+		if(swapBytes){
+			char tmp[sizeof(T)];
+			for(size_t b = 0; b < sizeof(T); ++b)
+				tmp[b] = src[sizeof(T) - 1 - b];
+			memcpy(&val, tmp, sizeof(T));
+		}
+		else
+			memcpy(&val, src, sizeof(T));
 
-//	create a buffer with which we can access the data
-	string str = base64_decode((const unsigned char*)dataNode->value(), strlen(dataNode->value()));
-	CHECK (str.size() % sizeof(T) == 0, "Bad base64 decoding");
+		if(targets.ptrs[ic])
+			targets.ptrs[ic][tuple * targets.stride] = (number)val;
 
-	if(str.empty()){
-		return;
+		if(++ic == numComps){
+			ic = 0;
+			++tuple;
+		}
 	}
+}
+
+
+///	properties of a VTKFile which are required to read its DataArrays
+struct DataArrayContext{
+	DataArrayContext() :
+		bigEndian(false), headerSize(4),
+		appendedData(NULL), appendedEnd(NULL), appendedRaw(false),
+		compressed(false)	{}
 
-	if(BigEndianSystem() != bigEndian){
-		SwapArrayEndianess(&str[0], str.size(), sizeof(T));
+	bool		bigEndian;
+	size_t		headerSize;		///< size of the byte count header of binary data (4 or 8)
+	const char*	appendedData;	///< first byte behind the '_' of AppendedData or NULL
+	const char*	appendedEnd;
+	bool		appendedRaw;	///< true if AppendedData is not base64 encoded
+	bool		compressed;		///< true if binary data was compressed by vtkZLibDataCompressor
+};
+
+
+///	reads an unsigned integer of size headerSize (4 or 8) in file byte order
+static uint64_t
+ReadHeaderValue(const unsigned char* p, size_t headerSize, bool swapBytes)
+{
+	unsigned char header[8];
+	memcpy(header, p, headerSize);
+	if(swapBytes)
+		reverse(header, header + headerSize);
+
+	if(headerSize == sizeof(uint64_t)){
+		uint64_t n;
+		memcpy(&n, header, sizeof(uint64_t));
+		return n;
 	}
 
-	size_t curSize = dataOut.size();
-	dataOut.resize(curSize + str.size() / sizeof(T));
-	memcpy((void*)(&dataOut.front() + curSize), (void*)(&str[0]), str.size());
+	uint32_t n;
+	memcpy(&n, header, sizeof(uint32_t));
+	return n;
 }
 
+
+///	decodes 'numValues' values of type T and writes them to 'targets'
+/**	The values are decoded in small blocks, which are converted to 'number'
+ * and byte-swapped while they are written to their destination. No buffer
+ * for the whole array is required.*/
 template <class T>
 static void
-ReadDataArrayASCII(std::vector<T>& dataOut,
-				   rapidxml::xml_node<>* dataNode,
-				   bool clearData)
+DecodeValues(Base64Decoder& decoder, size_t numValues, bool swapBytes,
+			 const ComponentTargets& targets)
 {
-	using namespace std;
+	const size_t blockSize = 4096 * sizeof(T);
+	char block[blockSize];
+	size_t numDone = 0;
+	while(numDone < numValues){
+		const size_t num = decoder.decode((unsigned char*)block,
+							min(blockSize, (numValues - numDone) * sizeof(T)));
+		CHECK (num > 0 && num % sizeof(T) == 0, "Bad base64 decoding");
+		ScatterValues<T>(block, num / sizeof(T), numDone, swapBytes, targets);
+		numDone += num / sizeof(T);
+	}
+}
+
 
-	if(clearData)
-		dataOut.clear();
+///	block layout of a DataArray which was compressed by vtkZLibDataCompressor
+/**	The data is split into blocks of blockSize bytes, which are compressed
+ * separately. The last block has lastBlockSize bytes if lastBlockSize is not 0.
+ * In the file, the header [numBlocks, blockSize, lastBlockSize,
+ * compressedSizes...] precedes the compressed blocks.*/
+struct CompressedBlocks{
+	size_t num_blocks() const	{return compressedSizes.size();}
+
+	uint64_t block_size(size_t i) const
+	{
+		return (i + 1 == num_blocks() && lastBlockSize != 0) ? lastBlockSize : blockSize;
+	}
 
-//	create a buffer with which we can access the data
-	string str(dataNode->value(), dataNode->value_size());
-	stringstream ss(str, ios_base::in);
+	uint64_t uncompressed_size() const
+	{
+		if(num_blocks() == 0)
+			return 0;
+		return (num_blocks() - 1) * blockSize + block_size(num_blocks() - 1);
+	}
 
-	while(!ss.eof()){
-	//	read the data
-		T d;
-		ss >> d;
+	uint64_t			blockSize;
+	uint64_t			lastBlockSize;
+	vector<uint64_t>	compressedSizes;
+	vector<uint64_t>	compressedOffsets;
+};
 
-	//	make sure that everything went right
-		if(ss.fail())
-			break;
 
-		dataOut.push_back(d);
+///	reads the header of a compressed DataArray through read(dest, numBytes)
+template <class TRead>
+static void
+ReadCompressedHeader(CompressedBlocks& blocks, size_t headerSize, bool swapBytes,
+					 TRead read)
+{
+	unsigned char header[3 * 8];
+	read(header, 3 * headerSize);
+	const uint64_t numBlocks = ReadHeaderValue(header, headerSize, swapBytes);
+	blocks.blockSize = ReadHeaderValue(header + headerSize, headerSize, swapBytes);
+	blocks.lastBlockSize = ReadHeaderValue(header + 2 * headerSize, headerSize, swapBytes);
+
+	CHECK (numBlocks < (uint64_t(1) << 32), "Bad number of compressed blocks: " << numBlocks);
+	vector<unsigned char> sizes(numBlocks * headerSize);
+	if(numBlocks > 0)
+		read(&sizes.front(), sizes.size());
+
+	blocks.compressedSizes.resize(numBlocks);
+	blocks.compressedOffsets.resize(numBlocks);
+	uint64_t offset = 0;
+	for(size_t i = 0; i < numBlocks; ++i){
+		blocks.compressedSizes[i] = ReadHeaderValue(&sizes[i * headerSize], headerSize, swapBytes);
+		blocks.compressedOffsets[i] = offset;
+		offset += blocks.compressedSizes[i];
 	}
 }
 
-template <class T>
+
+///	decompresses the blocks at 'compressed' in parallel and writes their values to the targets returned by allocate(numTuples)
+/**	Each block is converted to 'number' directly after it was decompressed.
+ * 'compressedSize' is the number of bytes available at 'compressed'.*/
+template <class T, class TAllocate>
 static void
-ReadDataArray(std::vector<T>& dataOut,
-			  rapidxml::xml_node<>* dataNode,
-			  bool bigEndian,
-			  const char* typeStr,
-			  bool clearData)
+DecompressValues(const CompressedBlocks& blocks, const unsigned char* compressed,
+				 size_t compressedSize, bool swapBytes, size_t numComps,
+				 TAllocate allocate)
 {
-	CHECK (strcmp(typeStr, GetAttribVal(dataNode, "type")) == 0,
-	       "Wrong data format! Expected: " << typeStr << ", found: "
-	       << GetAttribVal(dataNode, "type"));
+	const uint64_t numBytes = blocks.uncompressed_size();
+	CHECK (numBytes % (sizeof(T) * numComps) == 0, "Bad size of compressed DataArray");
+	CHECK (blocks.num_blocks() < 2 || blocks.blockSize % sizeof(T) == 0,
+		   "Unsupported block size of compressed DataArray: " << blocks.blockSize);
+	if(blocks.num_blocks() > 0){
+		CHECK (blocks.compressedOffsets.back() + blocks.compressedSizes.back() <= compressedSize,
+			   "Truncated compressed DataArray");
+	}
 
+	const size_t numValues = numBytes / sizeof(T);
+	const ComponentTargets targets = allocate(numValues / numComps);
+
+#ifdef UGVEC_WITH_ZLIB
+	ParallelFor(blocks.num_blocks(), NumThreads(), [&](size_t i){
+		vector<char> block(blocks.block_size(i));
+		uLongf size = (uLongf)block.size();
+		const int err = uncompress((Bytef*)block.data(), &size,
+								   compressed + blocks.compressedOffsets[i],
+								   (uLong)blocks.compressedSizes[i]);
+		CHECK (err == Z_OK && size == block.size(),
+			   "Decompression of block " << i << " of a DataArray failed");
+		ScatterValues<T>(block.data(), block.size() / sizeof(T),
+						 i * (blocks.blockSize / sizeof(T)), swapBytes, targets);
+	});
+#else
+	CHECK (0, "Compressed DataArrays are not supported, since ugvec was built without zlib.");
+#endif
+}
+
+
+///	decodes and decompresses a base64 encoded, compressed DataArray
+template <class T, class TAllocate>
+static void
+DecodeCompressedValues(Base64Decoder& decoder, const DataArrayContext& ctx,
+					   bool swapBytes, size_t numComps, TAllocate allocate)
+{
+	CompressedBlocks blocks;
+	ReadCompressedHeader(blocks, ctx.headerSize, swapBytes,
+		[&](unsigned char* dest, size_t num){
+			CHECK (decoder.decode(dest, num) == num, "Truncated compressed DataArray");
+		});
+
+	vector<unsigned char> compressed;
+	if(blocks.num_blocks() > 0){
+		compressed.resize(blocks.compressedOffsets.back() + blocks.compressedSizes.back());
+		CHECK (decoder.decode(&compressed.front(), compressed.size()) == compressed.size(),
+			   "Truncated compressed DataArray");
+	}
+
+	DecompressValues<T>(blocks, compressed.data(), compressed.size(), swapBytes,
+						numComps, allocate);
+}
+
+
+///	decodes a base64 encoded DataArray and writes its values to the targets returned by allocate(numTuples)
+/**	VTK writes the number of data bytes as an integer of size headerSize in
+ * front of the data. Arrays without this header are supported as well.*/
+template <class T, class TAllocate>
+static void
+ReadDataArrayBINARY(rapidxml::xml_node<>* dataNode,
+					const DataArrayContext& ctx,
+					size_t numComps,
+					TAllocate allocate)
+{
+	const unsigned char* src = (const unsigned char*)dataNode->value();
+	const size_t srcLen = dataNode->value_size();
+	const bool swapBytes = (BigEndianSystem() != (int)ctx.bigEndian);
+
+	if(ctx.compressed){
+		Base64Decoder decoder(src, srcLen);
+		DecodeCompressedValues<T>(decoder, ctx, swapBytes, numComps, allocate);
+		return;
+	}
+
+	uint64_t numBytes = base64_decoded_size(src, srcLen);
+
+	Base64Decoder decoder(src, srcLen);
+	if(numBytes >= ctx.headerSize){
+		unsigned char header[8];
+		decoder.decode(header, ctx.headerSize);
+		const uint64_t numDataBytes = ReadHeaderValue(header, ctx.headerSize, swapBytes);
+
+		if(numDataBytes == numBytes - ctx.headerSize)
+			numBytes = numDataBytes;
+		else
+			decoder = Base64Decoder(src, srcLen);
+	}
+
+	CHECK (numBytes % (sizeof(T) * numComps) == 0, "Bad base64 decoding");
+
+	const size_t numValues = numBytes / sizeof(T);
+	DecodeValues<T>(decoder, numValues, swapBytes, allocate(numValues / numComps));
+}
+
+
+///	reads a DataArray from the AppendedData section and writes its values to the targets returned by allocate(numTuples)
+/**	Raw data is converted directly from the memory-mapped file.*/
+template <class T, class TAllocate>
+static void
+ReadDataArrayAPPENDED(rapidxml::xml_node<>* dataNode,
+					  const DataArrayContext& ctx,
+					  size_t numComps,
+					  TAllocate allocate)
+{
+	CHECK (ctx.appendedData, "DataArray with format 'appended' but no AppendedData found");
+
+	const uint64_t offset = strtoull(GetAttribVal(dataNode, "offset"), NULL, 10);
+	const size_t available = ctx.appendedEnd - ctx.appendedData;
+	CHECK (offset < available, "Bad offset in appended DataArray: " << offset);
+
+	const unsigned char* src = (const unsigned char*)ctx.appendedData + offset;
+	const size_t srcLen = available - offset;
+	const bool swapBytes = (BigEndianSystem() != (int)ctx.bigEndian);
+
+	if(ctx.compressed && ctx.appendedRaw){
+		CompressedBlocks blocks;
+		const unsigned char* p = src;
+		ReadCompressedHeader(blocks, ctx.headerSize, swapBytes,
+			[&](unsigned char* dest, size_t num){
+				CHECK (num <= size_t(src + srcLen - p), "Truncated compressed DataArray");
+				memcpy(dest, p, num);
+				p += num;
+			});
+		DecompressValues<T>(blocks, p, src + srcLen - p, swapBytes, numComps, allocate);
+	}
+	else if(ctx.compressed){
+		Base64Decoder decoder(src, srcLen);
+		DecodeCompressedValues<T>(decoder, ctx, swapBytes, numComps, allocate);
+	}
+	else if(ctx.appendedRaw){
+		CHECK (srcLen >= ctx.headerSize, "Truncated appended DataArray");
+		const uint64_t numBytes = ReadHeaderValue(src, ctx.headerSize, swapBytes);
+		CHECK (numBytes <= srcLen - ctx.headerSize, "Truncated appended DataArray");
+		CHECK (numBytes % (sizeof(T) * numComps) == 0, "Bad size of appended DataArray");
+
+		const size_t numValues = numBytes / sizeof(T);
+		ScatterValues<T>((const char*)src + ctx.headerSize, numValues, 0, swapBytes,
+						 allocate(numValues / numComps));
+	}
+	else{
+	//	the encoded length is unknown. It is determined by the decoded header.
+		Base64Decoder decoder(src, srcLen);
+		unsigned char header[8];
+		CHECK (decoder.decode(header, ctx.headerSize) == ctx.headerSize,
+			   "Truncated appended DataArray");
+		const uint64_t numBytes = ReadHeaderValue(header, ctx.headerSize, swapBytes);
+		CHECK (numBytes % (sizeof(T) * numComps) == 0, "Bad size of appended DataArray");
+
+		const size_t numValues = numBytes / sizeof(T);
+		DecodeValues<T>(decoder, numValues, swapBytes, allocate(numValues / numComps));
+	}
+}
+
+
+///	parses an ascii DataArray in place and writes its values to the targets returned by allocate(numTuples)
+template <class T, class TAllocate>
+static void
+ReadDataArrayASCII(rapidxml::xml_node<>* dataNode,
+				   size_t numComps,
+				   TAllocate allocate)
+{
+	const char* begin = dataNode->value();
+	const char* end = begin + dataNode->value_size();
+
+	size_t numValues = 0;
+	for(const char* p = SkipSpaces(begin, end); p < end; p = SkipSpaces(p, end)){
+		++numValues;
+		while(p < end && !IsSpace(*p))
+			++p;
+	}
+
+	CHECK (numValues % numComps == 0, "Bad number of values in ascii DataArray");
+	const ComponentTargets targets = allocate(numValues / numComps);
+
+	size_t ic = 0;
+	size_t tuple = 0;
+	for(const char* p = SkipSpaces(begin, end); p < end; p = SkipSpaces(p, end)){
+		double d;
+		const char* next = ParseDouble(p, end, d);
+		CHECK (next != p, "Bad value in ascii DataArray");
+		p = next;
+
+	//	values are converted to T first, so that they are rounded as in the file's precision
+		if(targets.ptrs[ic])
+			targets.ptrs[ic][tuple * targets.stride] = (number)(T)d;
+
+		if(++ic == numComps){
+			ic = 0;
+			++tuple;
+		}
+	}
+}
+
+
+template <class T, class TAllocate>
+static void
+ReadDataArray(rapidxml::xml_node<>* dataNode,
+			  const DataArrayContext& ctx,
+			  size_t numComps,
+			  TAllocate allocate)
+{
 	const char* format = GetAttribVal(dataNode, "format");
 
 	if (strcmp(format, "ascii") == 0)
-		ReadDataArrayASCII<T> (dataOut, dataNode, clearData);
+		ReadDataArrayASCII<T> (dataNode, numComps, allocate);
 	else if (strcmp(format, "binary") == 0)
-		ReadDataArrayBINARY<T> (dataOut, dataNode, bigEndian, clearData);
+		ReadDataArrayBINARY<T> (dataNode, ctx, numComps, allocate);
+	else if (strcmp(format, "appended") == 0)
+		ReadDataArrayAPPENDED<T> (dataNode, ctx, numComps, allocate);
 	else {
 		CHECK (0, "Bad format in DataArray: " << format);
 	}
 }
 
+
+///	returns true if the type of the given DataArray is supported by ReadDataArray
+static bool
+IsSupportedType(rapidxml::xml_node<>* dataNode)
+{
+	const char* type = GetAttribVal(dataNode, "type");
+	return strcmp(type, "Float32") == 0 || strcmp(type, "Float64") == 0;
+}
+
+
+///	reads a DataArray of a supported type (see IsSupportedType)
+template <class TAllocate>
+static void
+ReadDataArray(rapidxml::xml_node<>* dataNode,
+			  const DataArrayContext& ctx,
+			  size_t numComps,
+			  TAllocate allocate)
+{
+	const char* type = GetAttribVal(dataNode, "type");
+	if(strcmp(type, "Float32") == 0)
+		ReadDataArray<float>(dataNode, ctx, numComps, allocate);
+	else if(strcmp(type, "Float64") == 0)
+		ReadDataArray<double>(dataNode, ctx, numComps, allocate);
+	else {
+		CHECK (0, "Unsupported type in DataArray: " << type);
+	}
+}
+
+
 bool Load_VTU (AlgebraicVector& av, const char* filename)
 {
-//	read the file into an xml-tree
-	ifstream in(filename, ios::binary);
-	if(!in)
+	MappedFile file;
+	if(!file.open(filename))
 		return false;
 
-//	get the length of the file
-	streampos posStart = in.tellg();
-	in.seekg(0, ios_base::end);
-	streampos posEnd = in.tellg();
-	streamsize size = posEnd - posStart;
-
-//	go back to the start of the file
-	in.seekg(posStart);
+	const char* fileBegin = file.data();
+	const char* fileEnd = fileBegin + file.size();
+
+//	Binary AppendedData can't be parsed by rapidxml. Only the xml part in
+//	front of it is copied and parsed, the appended data is read from the mapping.
+	const char appendedTag[] = "<AppendedData";
+	const char* appendedBegin = search(fileBegin, fileEnd, appendedTag,
+									   appendedTag + sizeof(appendedTag) - 1);
+	const char* xmlEnd = fileEnd;
+	const char* appendedData = NULL;
+	const char xmlClosing[] = "</AppendedData></VTKFile>";
+
+	if(appendedBegin != fileEnd){
+		xmlEnd = find(appendedBegin, fileEnd, '>');
+		CHECK(xmlEnd != fileEnd, "Bad AppendedData tag in " << filename);
+		++xmlEnd;
+		appendedData = find(xmlEnd, fileEnd, '_');
+		CHECK(appendedData != fileEnd, "AppendedData does not start with '_' in " << filename);
+		++appendedData;
+	}
 
 	rapidxml::xml_document<>	doc;
 
-//	read the whole file en-block and terminate it with 0
-	char* fileContent = doc.allocate_string(0, size + 1);
-	in.read(fileContent, size);
-	fileContent[size] = 0;
-	in.close();
+//	copy the xml part and terminate it with 0
+	const size_t xmlSize = xmlEnd - fileBegin;
+	const size_t closingSize = appendedData ? sizeof(xmlClosing) - 1 : 0;
+	char* fileContent = doc.allocate_string(0, xmlSize + closingSize + 1);
+	memcpy(fileContent, fileBegin, xmlSize);
+	memcpy(fileContent + xmlSize, xmlClosing, closingSize);
+	fileContent[xmlSize + closingSize] = 0;
 
 //	parse the xml-data
 	doc.parse<0>(fileContent);
@@ -231,92 +564,148 @@ bool Load_VTU (AlgebraicVector& av, const char* filename)
 	xml_node<>* pointsDataArrayNode = pointsNode->first_node("DataArray");
 	CHECK(pointsDataArrayNode, "Specified points node does not contain a DataArray node!");
 
-	const bool bigEndian = 
-			(strcmp(GetAttribVal(vtkNode, "byte_order"), "BigEndian") == 0);
-
+	DataArrayContext ctx;
+	ctx.bigEndian = (strcmp(GetAttribVal(vtkNode, "byte_order"), "BigEndian") == 0);
+	ctx.headerSize =
+			(strcmp(GetAttribVal(vtkNode, "header_type", "UInt32"), "UInt64") == 0) ? 8 : 4;
+
+	if(appendedData){
+		xml_node<>* appendedNode = vtkNode->first_node("AppendedData");
+		CHECK(appendedNode, "Bad AppendedData section in " << filename);
+		ctx.appendedData = appendedData;
+		ctx.appendedEnd = fileEnd;
+		ctx.appendedRaw = (strcmp(GetAttribVal(appendedNode, "encoding"), "raw") == 0);
+	}
 
-	vector<float> data; // warning: reused several times during parsing!
+	const char* compressor = GetAttribVal(vtkNode, "compressor", "");
+	if(*compressor){
+		CHECK(strcmp(compressor, "vtkZLibDataCompressor") == 0,
+			  "Unsupported compressor '" << compressor << "' in " << filename);
+		ctx.compressed = true;
+	}
 
-//	read position data
-	ReadDataArray<float>(data, pointsDataArrayNode, bigEndian, "Float32", true);
 
+//	read position data directly into the nodes
 	const int pointDimTmp = atoi(GetAttribVal(pointsDataArrayNode, "NumberOfComponents"));
 	CHECK(pointDimTmp > 0, "Bad coordinate dimension specified: " << pointDimTmp);
 
 	const size_t pointDim = (size_t) pointDimTmp;
-	const size_t numPoints = data.size() / pointDim;
+	size_t numPoints = 0;
 
 	av.worldDim = pointDim;
 
-	{
-		const size_t numComps = pointDim;
+	struct AllocateNodes{
+		AllocateNodes(AlgebraicVector& av, size_t pointDim, size_t& numPoints, const char* filename) :
+			av(av), pointDim(pointDim), numPoints(numPoints), filename(filename) {}
+
+		ComponentTargets operator () (size_t num)
+		{
+			CHECK(num < (size_t)numeric_limits<uint>::max(),
+				  "Too many points in " << filename);
+			numPoints = num;
+			av.nodes.clear();
+			av.nodes.resize(num);
+
+			ComponentTargets targets;
+			targets.stride = sizeof(Node) / sizeof(number);
+			number* coords = av.nodes.data()->coord;
+			for(size_t ic = 0; ic < pointDim; ++ic)
+				targets.ptrs.push_back(ic < 3 ? coords + ic : NULL);
+			return targets;
+		}
 
-		av.positions.clear();
-		av.positions.resize(numPoints);
+		AlgebraicVector&	av;
+		size_t				pointDim;
+		size_t&				numPoints;
+		const char*			filename;
+	};
 
-		for(size_t ipoint = 0; ipoint < numPoints; ++ipoint){
-			const size_t dataInd = ipoint * pointDim;
-			for(size_t ic = 0; ic < numComps; ++ic){
-				av.positions[ipoint].coord[ic] = data[dataInd + ic];
-			}
-		}
-	}
+	CHECK(IsSupportedType(pointsDataArrayNode),
+		  "Unsupported type of points in " << filename);
+	ReadDataArray(pointsDataArrayNode, ctx, pointDim,
+				  AllocateNodes(av, pointDim, numPoints, filename));
 
+//	each component of the vector is defined on all points
+	vector<uint> compNodes(numPoints);
+	for(size_t ipoint = 0; ipoint < numPoints; ++ipoint)
+		compNodes[ipoint] = (uint)ipoint;
 
-//	read data values
+
+//	read data values directly into new components
 	xml_node<>* pointDataNode = pieceNode->first_node("PointData");
 	CHECK(pointDataNode, "Specified piece does not contain a PointData node!");
 
 	xml_node<>* curDataNode = pointDataNode->first_node("DataArray");
 	CHECK(curDataNode, "At least one DataArray node in the PointData node is expected.");
 
+	av.comps.clear();
 	int compCounter = 0;
 
-	cout << "  Components of '" << filename << "':" << endl;
+	ostringstream compLog;
+	compLog << "  Components of '" << filename << "':" << endl;
+
+	struct AllocateComponents{
+		AllocateComponents(AlgebraicVector& av, size_t numComps, size_t numPoints,
+						   const vector<uint>& compNodes, const char* filename) :
+			av(av), numComps(numComps), numPoints(numPoints),
+			compNodes(compNodes), filename(filename) {}
+
+		ComponentTargets operator () (size_t num)
+		{
+			CHECK(num == numPoints,
+				  "Bad number of entries in point data array of " << filename);
+
+			const size_t firstComp = av.comps.size();
+			av.comps.resize(firstComp + numComps);
+
+			ComponentTargets targets;
+			targets.stride = 1;
+			for(size_t ic = 0; ic < numComps; ++ic){
+				Component& comp = av.comps[firstComp + ic];
+				comp.nodes = compNodes;
+				comp.data.resize(numPoints);
+				targets.ptrs.push_back(comp.data.data());
+			}
+			return targets;
+		}
+
+		AlgebraicVector&		av;
+		size_t					numComps;
+		size_t					numPoints;
+		const vector<uint>&		compNodes;
+		const char*				filename;
+	};
 
 	while (curDataNode) {
 
-		if(strcmp(GetAttribVal(curDataNode, "type"), "Float32") != 0){
-			cout << "   VTU WARNING: ignoring component '"
+		if(!IsSupportedType(curDataNode)){
+			compLog << "   VTU WARNING: ignoring component '"
 				 << GetAttribVal(curDataNode, "name", "unknown")
-				 << "' due to unsupported type. Float32 expected.\n";
+				 << "' due to unsupported type. Float32 or Float64 expected.\n";
+			curDataNode = curDataNode->next_sibling("DataArray");
 			continue;
 		}
 
 		const int numComps = atoi(GetAttribVal(curDataNode, "NumberOfComponents"));
 		CHECK(numComps > 0, "Bad number of components in point data array");
 
-		ReadDataArray<float>(data, curDataNode, bigEndian, "Float32", true);
-		av.data.reserve(av.data.size() + data.size());
+		ReadDataArray(curDataNode, ctx, numComps,
+					  AllocateComponents(av, numComps, numPoints, compNodes, filename));
 
 		for(int ic = 0; ic < numComps; ++ic){
-			if(compCounter > 0) {
-			//	copy position data for this component
-				const size_t firstNew = av.positions.size();
-				av.positions.resize(av.positions.size() + numPoints);
-				for(size_t ip = 0; ip < numPoints; ++ip){
-					av.positions[firstNew + ip] = av.positions[ip];
-					av.positions[firstNew + ip].ci = compCounter;
-				}
-			}
-
-			cout << "    " << compCounter << ":\t"
+			compLog << "    " << compCounter << ":\t"
 				 << GetAttribVal(curDataNode, "name", "unknown");
 			if(numComps > 1){
-				cout << " [" << ic << "]";
-			}
-			cout << endl;
-
-			for(size_t i = 0; i < data.size(); i += numComps){
-				av.data.push_back(data[i]);
+				compLog << " [" << ic << "]";
 			}
-
+			compLog << endl;
 			++compCounter;
 		}
 
 		curDataNode = curDataNode->next_sibling("DataArray");
 	}
 
+	LOG(compLog.str());
 	return true;
 }
 
@@ -370,37 +759,12 @@ bool Load_PVTU (AlgebraicVector& av, const char* filename, bool makeConsistent)
 	xml_node<>* curPieceNode = ugridNode->first_node("Piece");
 	CHECK(curPieceNode, "At least one Piece node is expected.");
 
-	bool useGlobPosMap = false;
-	#ifdef PARALLEL_LOAD_SPEEDUP
-		useGlobPosMap = (numFiles > 1);
-	#endif
-
-	std::map<Position, size_t> globPosMap;
-
+	vector<string> files;
 	while (curPieceNode) {
         string serialFile = GetAttribVal(curPieceNode, "Source");
-        string tfilename = path + serialFile;
-        AlgebraicVector tmpAv;
-        if(Load_VTU(tmpAv, tfilename.c_str())){
-        	if(useGlobPosMap){
-        		cout << "  using parallel load speedup.\n";
-				if(makeConsistent)
-					av.add_vector(tmpAv, globPosMap);
-				else
-					av.unite_with_vector(tmpAv, globPosMap);
-			}
-			else{
-				if(makeConsistent)
-					av.add_vector(tmpAv);
-				else
-					av.unite_with_vector(tmpAv);
-			}
-        }
-        else
-            return false;
-
+        files.push_back(path + serialFile);
         curPieceNode = curPieceNode->next_sibling("Piece");
     }
 
-	return true;
-}
\ No newline at end of file
+	return LoadPieces(av, files, makeConsistent, &Load_VTU);
+}
@@ -0,0 +1,184 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <limits>
+
+#include "kd_tree.h"
+#include "parallel.h"
+#include "ugvec_base.h"
+
+using namespace std;
+
+const size_t KDTree::leafSize;
+
+void KDTree::
+build(const vector<Node>& points, int worldDim)
+{
+	CHECK(points.size() < (size_t)numeric_limits<uint>::max(),
+		  "Too many points for KDTree.");
+
+	m_worldDim = max(1, min(worldDim, 3));
+	m_entries.resize(points.size());
+	m_splitDim.assign(points.size(), 0);
+	for(size_t i = 0; i < points.size(); ++i){
+		m_entries[i].p = points[i];
+		m_entries[i].ind = (uint)i;
+	}
+
+//	the upper levels are split serially until there are enough independent
+//	subtrees, which are then built in parallel
+	const int numThreads = NumThreads();
+	vector<Range> ranges(1, Range(0, m_entries.size()));
+	while(ranges.size() < 8 * (size_t)numThreads){
+		vector<Range> nextRanges;
+		bool splitAny = false;
+		for(size_t i = 0; i < ranges.size(); ++i){
+			const Range& r = ranges[i];
+			if(r.end - r.begin <= leafSize){
+				nextRanges.push_back(r);
+				continue;
+			}
+			split(r.begin, r.end);
+			const size_t mid = r.begin + (r.end - r.begin) / 2;
+			nextRanges.push_back(Range(r.begin, mid));
+			nextRanges.push_back(Range(mid + 1, r.end));
+			splitAny = true;
+		}
+		ranges.swap(nextRanges);
+		if(!splitAny)
+			break;
+	}
+
+	ParallelFor(ranges.size(), numThreads,
+		[&](size_t i){build_serial(ranges[i].begin, ranges[i].end);});
+}
+
+
+///	moves the median of [begin, end) along the dimension of largest extent to its center
+void KDTree::
+split(size_t begin, size_t end)
+{
+	Node minCorner = m_entries[begin].p;
+	Node maxCorner = minCorner;
+	for(size_t i = begin + 1; i < end; ++i){
+		const Node& p = m_entries[i].p;
+		for(int d = 0; d < m_worldDim; ++d){
+			minCorner.coord[d] = min(minCorner.coord[d], p.coord[d]);
+			maxCorner.coord[d] = max(maxCorner.coord[d], p.coord[d]);
+		}
+	}
+
+	int dim = 0;
+	for(int d = 1; d < m_worldDim; ++d){
+		if(maxCorner.coord[d] - minCorner.coord[d] > maxCorner.coord[dim] - minCorner.coord[dim])
+			dim = d;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	nth_element(m_entries.begin() + begin, m_entries.begin() + mid, m_entries.begin() + end,
+				[dim](const Entry& e1, const Entry& e2){
+					if(e1.p.coord[dim] != e2.p.coord[dim])
+						return e1.p.coord[dim] < e2.p.coord[dim];
+					return e1.ind < e2.ind;
+				});
+	m_splitDim[mid] = (unsigned char)dim;
+}
+
+
+void KDTree::
+build_serial(size_t begin, size_t end)
+{
+	if(end - begin <= leafSize)
+		return;
+	split(begin, end);
+	const size_t mid = begin + (end - begin) / 2;
+	build_serial(begin, mid);
+	build_serial(mid + 1, end);
+}
+
+
+///	inserts (ind, distSq) into the sorted candidate list if it is among the k best
+static inline void
+InsertCandidate(uint ind, number distSq, size_t k,
+				size_t& numFound, uint* inds, number* dists)
+{
+	if(numFound == k
+	   && (distSq > dists[k - 1] || (distSq == dists[k - 1] && ind > inds[k - 1])))
+	{
+		return;
+	}
+
+	size_t i = (numFound < k) ? numFound++ : k - 1;
+	while(i > 0 && (dists[i - 1] > distSq || (dists[i - 1] == distSq && inds[i - 1] > ind))){
+		inds[i] = inds[i - 1];
+		dists[i] = dists[i - 1];
+		--i;
+	}
+	inds[i] = ind;
+	dists[i] = distSq;
+}
+
+
+void KDTree::
+search(size_t begin, size_t end, const Node& p, size_t k,
+	   size_t& numFound, uint* inds, number* dists) const
+{
+	if(end - begin <= leafSize){
+		for(size_t i = begin; i < end; ++i){
+			const Entry& e = m_entries[i];
+			number distSq = 0;
+			for(int d = 0; d < m_worldDim; ++d){
+				const number diff = e.p.coord[d] - p.coord[d];
+				distSq += diff * diff;
+			}
+			InsertCandidate(e.ind, distSq, k, numFound, inds, dists);
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	const Entry& e = m_entries[mid];
+	const int dim = m_splitDim[mid];
+
+	number distSq = 0;
+	for(int d = 0; d < m_worldDim; ++d){
+		const number diff = e.p.coord[d] - p.coord[d];
+		distSq += diff * diff;
+	}
+	InsertCandidate(e.ind, distSq, k, numFound, inds, dists);
+
+//	the side which contains p is searched first. The other side only has to
+//	be searched if it may contain points which are at least as close as the
+//	current k-th candidate.
+	const number planeDist = p.coord[dim] - e.p.coord[dim];
+	const bool leftFirst = planeDist < 0;
+
+	if(leftFirst)
+		search(begin, mid, p, k, numFound, inds, dists);
+	else
+		search(mid + 1, end, p, k, numFound, inds, dists);
+
+	if(numFound < k || planeDist * planeDist <= dists[k - 1]){
+		if(leftFirst)
+			search(mid + 1, end, p, k, numFound, inds, dists);
+		else
+			search(begin, mid, p, k, numFound, inds, dists);
+	}
+}
+
+
+size_t KDTree::
+find_nearest(const Node& p, size_t k, uint* indsOut, number* distSqOut) const
+{
+	if(k == 0 || m_entries.empty())
+		return 0;
+	size_t numFound = 0;
+	search(0, m_entries.size(), p, k, numFound, indsOut, distSqOut);
+	return numFound;
+}
@@ -0,0 +1,69 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_kd_tree
+#define __H__ugvec_kd_tree
+
+#include <vector>
+#include "algebraic_vector.h"
+#include "ugvec_base.h"
+
+///	k-d tree for nearest neighbour queries on a set of points
+/**	The tree is stored implicitly: points are permuted so that each subtree
+ * occupies a contiguous range whose median point is the splitting point.
+ * Ranges are split along the dimension of their largest extent. Ranges with
+ * at most 'leafSize' points are leaves, which are searched linearly.
+ *
+ * No memory is allocated per tree node besides the split dimension of each
+ * inner node. Building and querying are thread safe in the sense that 'build'
+ * uses NumThreads() threads (see parallel.h) and any number of threads may
+ * call 'find_nearest' concurrently on a built tree.*/
+class KDTree{
+	public:
+		static const size_t leafSize = 8;
+
+		KDTree() : m_worldDim(0)	{}
+
+	///	builds the tree for the first worldDim coordinates of the given points
+		void build(const std::vector<Node>& points, int worldDim);
+
+		size_t size() const		{return m_entries.size();}
+
+	///	finds the k nearest points of p
+	/**	Writes the indices (into the array passed to 'build') and squared
+	 * distances of the found points to indsOut and distSqOut, sorted by
+	 * ascending distance. Ties are broken by the smaller index. Both arrays
+	 * have to provide space for k entries. Returns the number of found
+	 * points, which is min(k, size()).*/
+		size_t find_nearest(const Node& p, size_t k,
+							uint* indsOut, number* distSqOut) const;
+
+	private:
+		struct Entry{
+			Node	p;
+			uint	ind;
+		};
+
+		struct Range{
+			Range(size_t b, size_t e) : begin(b), end(e)	{}
+			size_t begin;
+			size_t end;
+		};
+
+		void split(size_t begin, size_t end);
+		void build_serial(size_t begin, size_t end);
+		void search(size_t begin, size_t end, const Node& p, size_t k,
+					size_t& numFound, uint* inds, number* distSq) const;
+
+		int							m_worldDim;
+		std::vector<Entry>			m_entries;
+	///	m_splitDim[mid] is the split dimension of the range whose median is mid
+		std::vector<unsigned char>	m_splitDim;
+};
+
+#endif	//__H__ugvec_kd_tree
@@ -0,0 +1,118 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <fstream>
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+using namespace std;
+
+MappedFile::
+MappedFile() :
+	m_data(NULL),
+	m_size(0),
+	m_isOpen(false),
+	m_mapped(false)
+{
+}
+
+MappedFile::
+~MappedFile()
+{
+	close();
+}
+
+
+bool MappedFile::
+open(const char* filename)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		::close(fd);
+		return false;
+	}
+
+	m_size = (size_t)st.st_size;
+	if(m_size > 0){
+		void* p = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED){
+			::close(fd);
+			m_size = 0;
+			return false;
+		}
+		madvise(p, m_size, MADV_SEQUENTIAL);
+		m_data = (const char*)p;
+		m_mapped = true;
+	}
+
+//	the mapping stays valid after the descriptor was closed
+	::close(fd);
+#else
+	ifstream in(filename, ios::binary);
+	if(!in)
+		return false;
+
+	in.seekg(0, ios_base::end);
+	m_size = (size_t)in.tellg();
+	in.seekg(0, ios_base::beg);
+	m_buffer.resize(m_size);
+	if(m_size > 0){
+		in.read(&m_buffer.front(), m_size);
+		m_data = &m_buffer.front();
+	}
+#endif
+
+	m_isOpen = true;
+	return true;
+}
+
+
+void MappedFile::
+close()
+{
+#ifndef _WIN32
+	if(m_mapped)
+		munmap((void*)m_data, m_size);
+#endif
+	vector<char>().swap(m_buffer);
+	m_data = NULL;
+	m_size = 0;
+	m_isOpen = false;
+	m_mapped = false;
+}
+
+
+void MappedFile::
+release(const char* begin, const char* end)
+{
+#ifndef _WIN32
+	if(!m_mapped || begin >= end)
+		return;
+
+//	only whole pages inside the range are released
+	const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t first = ((begin - m_data) + pageSize - 1) / pageSize * pageSize;
+	const size_t last = (end - m_data) / pageSize * pageSize;
+	if(first < last)
+		madvise((void*)(m_data + first), last - first, MADV_DONTNEED);
+#endif
+}
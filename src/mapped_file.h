@@ -0,0 +1,48 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_mapped_file
+#define __H__ugvec_mapped_file
+
+#include <cstddef>
+#include <vector>
+
+///	Read-only view of a whole file.
+/**	On POSIX systems the file is memory-mapped. On other systems its content
+ * is read into a buffer. The content is not zero-terminated.*/
+class MappedFile{
+	public:
+		MappedFile();
+		~MappedFile();
+
+	///	returns false if the file could not be opened or mapped
+		bool open(const char* filename);
+		void close();
+
+		bool is_open() const		{return m_isOpen;}
+		const char* data() const	{return m_data;}
+		size_t size() const			{return m_size;}
+
+	///	tells the system that the pages of the given range won't be accessed soon
+	/**	The content stays valid. If released pages are accessed again, they are
+	 * read from the file again. Used to keep the resident memory of long
+	 * sequential scans bounded.*/
+		void release(const char* begin, const char* end);
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator = (const MappedFile&);
+
+		const char*			m_data;
+		size_t				m_size;
+		bool				m_isOpen;
+		bool				m_mapped;
+		std::vector<char>	m_buffer;
+};
+
+#endif	//__H__ugvec_mapped_file
@@ -0,0 +1,389 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_merge_index
+#define __H__ugvec_merge_index
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include "algebraic_vector.h"
+#include "ugvec_base.h"
+
+///	returns the bit pattern of a coordinate. -0 is mapped to the pattern of 0.
+inline uint64_t CoordinateBits(number c)
+{
+	if(c == 0)
+		c = 0;
+	uint64_t bits;
+	memcpy(&bits, &c, sizeof(bits));
+	return bits;
+}
+
+
+///	Open addressing hash table which maps node coordinates to node indices.
+/**	The table only stores node indices (together with their hash values).
+ * Coordinates are looked up in the node array which is passed to each method
+ * and which has to be the same array for all calls on one index.
+ *
+ * Nodes are compared by the exact bit pattern of their coordinates. The only
+ * exception is -0, which is treated as 0, so that the index matches Node::operator ==
+ * for all non-nan coordinates.
+ *
+ * Linear probing is used and the table is kept at most half full. No memory
+ * is allocated per entry.*/
+class NodeHashIndex{
+	public:
+		static const uint INVALID = (uint)-1;
+
+		NodeHashIndex() : m_numEntries(0)	{}
+
+		void clear()
+		{
+			m_slots.clear();
+			m_numEntries = 0;
+		}
+
+	///	makes sure that numNodes nodes can be inserted without rehashing
+		void reserve(size_t numNodes)
+		{
+			size_t cap = 16;
+			while(cap < 2 * numNodes)
+				cap *= 2;
+			if(cap > m_slots.size())
+				rehash(cap);
+		}
+
+		size_t size() const		{return m_numEntries;}
+
+	///	returns the index of a node with the coordinates of n or INVALID.
+		template <class TNodeArray>
+		uint find(const Node& n, const TNodeArray& nodes) const
+		{
+			if(m_slots.empty())
+				return INVALID;
+
+			const uint h = hash(n);
+			const size_t mask = m_slots.size() - 1;
+			for(size_t i = h & mask;; i = (i + 1) & mask){
+				const Slot& s = m_slots[i];
+				if(s.ind == INVALID)
+					return INVALID;
+				if(s.hash == h && same(nodes[s.ind], n))
+					return s.ind;
+			}
+		}
+
+	///	returns the index of a node with the coordinates of n. If no such node exists, newInd is inserted and returned.
+	/**	newInd has to be the index of n in the associated node array after
+	 * the call. Note that the node itself doesn't have to be contained in the
+	 * node array at the time of this call.*/
+		template <class TNodeArray>
+		uint find_or_insert(const Node& n, uint newInd, const TNodeArray& nodes)
+		{
+			if(2 * (m_numEntries + 1) > m_slots.size())
+				rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+
+			const uint h = hash(n);
+			const size_t mask = m_slots.size() - 1;
+			for(size_t i = h & mask;; i = (i + 1) & mask){
+				Slot& s = m_slots[i];
+				if(s.ind == INVALID){
+					s.ind = newInd;
+					s.hash = h;
+					++m_numEntries;
+					return newInd;
+				}
+				if(s.hash == h && same(nodes[s.ind], n))
+					return s.ind;
+			}
+		}
+
+		static uint hash(const Node& n);
+		static bool same(const Node& n1, const Node& n2)
+		{
+			return CoordinateBits(n1.x) == CoordinateBits(n2.x)
+				&& CoordinateBits(n1.y) == CoordinateBits(n2.y)
+				&& CoordinateBits(n1.z) == CoordinateBits(n2.z);
+		}
+
+	private:
+		struct Slot{
+			Slot() : ind(INVALID), hash(0)	{}
+			uint	ind;
+			uint	hash;
+		};
+
+		void rehash(size_t newCapacity)
+		{
+			std::vector<Slot> oldSlots(newCapacity);
+			m_slots.swap(oldSlots);
+			const size_t mask = m_slots.size() - 1;
+			for(size_t iold = 0; iold < oldSlots.size(); ++iold){
+				const Slot& s = oldSlots[iold];
+				if(s.ind == INVALID)
+					continue;
+				size_t i = s.hash & mask;
+				while(m_slots[i].ind != INVALID)
+					i = (i + 1) & mask;
+				m_slots[i] = s;
+			}
+		}
+
+		std::vector<Slot>	m_slots;
+		size_t				m_numEntries;
+};
+
+
+inline uint NodeHashIndex::
+hash(const Node& n)
+{
+	uint64_t h = CoordinateBits(n.x) * 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (h >> 32) ^ CoordinateBits(n.y)) * 0xC2B2AE3D27D4EB4FULL;
+	h = (h ^ (h >> 32) ^ CoordinateBits(n.z)) * 0x165667B19E3779F9ULL;
+	return (uint)(h ^ (h >> 32));
+}
+
+
+///	Spatial hash grid which maps node coordinates to the nearest node within a tolerance
+/**	Nodes are sorted into cubic cells with edge length 2*tolerance. The cells
+ * are stored in an open addressing hash table whose slots hold the cell
+ * coordinates and the index of one node of the cell. Further nodes of a cell
+ * are chained through 'm_next'. A query only visits the (at most 8) cells
+ * which overlap the box of edge length 2*tolerance around the queried node.
+ *
+ * A node matches if its euclidean distance to the queried node is at most
+ * 'tolerance'. If several nodes match, the nearest one is returned. Ties are
+ * broken by the smaller node index.
+ *
+ * As for NodeHashIndex, coordinates are looked up in the node array which is
+ * passed to each method.*/
+class NodeGridIndex{
+	public:
+		static const uint INVALID = NodeHashIndex::INVALID;
+
+		NodeGridIndex() : m_tolerance(0), m_invCellSize(0), m_numCells(0)	{}
+
+	///	sets the tolerance and clears the index. tol has to be positive.
+		void set_tolerance(number tol)
+		{
+			clear();
+			m_tolerance = tol;
+			m_invCellSize = 1. / (2. * tol);
+		}
+
+		number tolerance() const	{return m_tolerance;}
+
+		void clear()
+		{
+			m_slots.clear();
+			m_next.clear();
+			m_numCells = 0;
+		}
+
+	///	makes sure that numNodes nodes can be inserted without rehashing
+		void reserve(size_t numNodes)
+		{
+			m_next.reserve(numNodes);
+			size_t cap = 16;
+			while(cap < 2 * numNodes)
+				cap *= 2;
+			if(cap > m_slots.size())
+				rehash(cap);
+		}
+
+	///	returns the index of the nearest node within the tolerance around n or INVALID.
+		template <class TNodeArray>
+		uint find(const Node& n, const TNodeArray& nodes) const
+		{
+			if(m_slots.empty())
+				return INVALID;
+
+			int64_t lo[3], hi[3];
+			for(int d = 0; d < 3; ++d){
+				lo[d] = cell_coord(n.coord[d] - m_tolerance);
+				hi[d] = cell_coord(n.coord[d] + m_tolerance);
+			}
+
+			uint best = INVALID;
+			number bestDistSq = m_tolerance * m_tolerance;
+			int64_t c[3];
+			for(c[2] = lo[2]; c[2] <= hi[2]; ++c[2]){
+				for(c[1] = lo[1]; c[1] <= hi[1]; ++c[1]){
+					for(c[0] = lo[0]; c[0] <= hi[0]; ++c[0]){
+						const Slot* s = find_slot(c);
+						if(!s)
+							continue;
+						for(uint ind = s->first; ind != INVALID; ind = m_next[ind]){
+							const Node& p = nodes[ind];
+							const number dx = p.x - n.x;
+							const number dy = p.y - n.y;
+							const number dz = p.z - n.z;
+							const number distSq = dx * dx + dy * dy + dz * dz;
+							if(distSq < bestDistSq
+							   || (distSq == bestDistSq && ind < best))
+							{
+								best = ind;
+								bestDistSq = distSq;
+							}
+						}
+					}
+				}
+			}
+			return best;
+		}
+
+	///	returns the index of the nearest node within the tolerance around n. If no such node exists, newInd is inserted and returned.
+	/**	See NodeHashIndex::find_or_insert for the requirements on newInd.*/
+		template <class TNodeArray>
+		uint find_or_insert(const Node& n, uint newInd, const TNodeArray& nodes)
+		{
+			const uint ind = find(n, nodes);
+			if(ind != INVALID)
+				return ind;
+
+			if(2 * (m_numCells + 1) > m_slots.size())
+				rehash(m_slots.empty() ? 16 : 2 * m_slots.size());
+
+			if(newInd >= m_next.size())
+				m_next.resize(newInd + 1, INVALID);
+
+			int64_t c[3];
+			for(int d = 0; d < 3; ++d)
+				c[d] = cell_coord(n.coord[d]);
+
+			const uint h = hash_cell(c);
+			const size_t mask = m_slots.size() - 1;
+			for(size_t i = h & mask;; i = (i + 1) & mask){
+				Slot& s = m_slots[i];
+				if(s.first == INVALID){
+					for(int d = 0; d < 3; ++d)
+						s.cell[d] = c[d];
+					s.hash = h;
+					++m_numCells;
+				}
+				else if(s.hash != h || !same_cell(s.cell, c))
+					continue;
+
+				m_next[newInd] = s.first;
+				s.first = newInd;
+				return newInd;
+			}
+		}
+
+	private:
+		struct Slot{
+			Slot() : first(INVALID), hash(0)	{cell[0] = cell[1] = cell[2] = 0;}
+			int64_t	cell[3];
+			uint	first;
+			uint	hash;
+		};
+
+	///	index of the cell which contains the coordinate c. Clamped to avoid overflows.
+		int64_t cell_coord(number c) const
+		{
+			const number lim = 4.e18;
+			number v = std::floor(c * m_invCellSize);
+			if(!(v > -lim))
+				v = -lim;
+			else if(v > lim)
+				v = lim;
+			return (int64_t)v;
+		}
+
+		static bool same_cell(const int64_t* c1, const int64_t* c2)
+		{
+			return c1[0] == c2[0] && c1[1] == c2[1] && c1[2] == c2[2];
+		}
+
+		static uint hash_cell(const int64_t* c)
+		{
+			uint64_t h = (uint64_t)c[0] * 0x9E3779B97F4A7C15ULL;
+			h = (h ^ (h >> 32) ^ (uint64_t)c[1]) * 0xC2B2AE3D27D4EB4FULL;
+			h = (h ^ (h >> 32) ^ (uint64_t)c[2]) * 0x165667B19E3779F9ULL;
+			return (uint)(h ^ (h >> 32));
+		}
+
+		const Slot* find_slot(const int64_t* c) const
+		{
+			const uint h = hash_cell(c);
+			const size_t mask = m_slots.size() - 1;
+			for(size_t i = h & mask;; i = (i + 1) & mask){
+				const Slot& s = m_slots[i];
+				if(s.first == INVALID)
+					return NULL;
+				if(s.hash == h && same_cell(s.cell, c))
+					return &s;
+			}
+		}
+
+		void rehash(size_t newCapacity)
+		{
+			std::vector<Slot> oldSlots(newCapacity);
+			m_slots.swap(oldSlots);
+			const size_t mask = m_slots.size() - 1;
+			for(size_t iold = 0; iold < oldSlots.size(); ++iold){
+				const Slot& s = oldSlots[iold];
+				if(s.first == INVALID)
+					continue;
+				size_t i = s.hash & mask;
+				while(m_slots[i].first != INVALID)
+					i = (i + 1) & mask;
+				m_slots[i] = s;
+			}
+		}
+
+		number				m_tolerance;
+		number				m_invCellSize;
+		std::vector<Slot>	m_slots;
+		size_t				m_numCells;
+	///	m_next[nodeInd] holds the next node in the cell of nodeInd or INVALID
+		std::vector<uint>	m_next;
+};
+
+
+///	Allows to quickly find nodes and entries of an AlgebraicVector during merges.
+/**	An index can be passed to several subsequent calls of add_vector or
+ * unite_with_vector on the same target vector. It has to be created for that
+ * target vector through 'init' and may only be modified by those merge methods.
+ *
+ * If MatchTolerance() is positive when 'init' is called, nodes are matched
+ * through 'gridIndex' instead of the exact 'nodeIndex'.*/
+struct MergeIndex{
+	static const uint INVALID = NodeHashIndex::INVALID;
+
+	MergeIndex() : tolerance(0)	{}
+
+	void init(const AlgebraicVector& av);
+
+	void reserve(size_t numNodes)
+	{
+		if(tolerance > 0)
+			gridIndex.reserve(numNodes);
+		else
+			nodeIndex.reserve(numNodes);
+	}
+
+///	see NodeHashIndex::find_or_insert and NodeGridIndex::find_or_insert
+	template <class TNodeArray>
+	uint find_or_insert(const Node& n, uint newInd, const TNodeArray& nodes)
+	{
+		if(tolerance > 0)
+			return gridIndex.find_or_insert(n, newInd, nodes);
+		return nodeIndex.find_or_insert(n, newInd, nodes);
+	}
+
+	number							tolerance;
+	NodeHashIndex					nodeIndex;
+	NodeGridIndex					gridIndex;
+///	entryMap[ci][nodeInd] holds the index of the entry in component ci or INVALID
+	std::vector<std::vector<uint> >	entryMap;
+};
+
+#endif	//__H__ugvec_merge_index
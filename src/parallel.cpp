@@ -0,0 +1,181 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+using namespace std;
+
+static int g_numThreads = 1;
+
+//	true on worker threads of ParallelFor and OrderedPipeline. Parallel
+//	algorithms which are called from such a thread run serially, since all
+//	threads are already busy.
+static thread_local bool t_isWorker = false;
+
+void SetNumThreads(int numThreads)
+{
+	if(numThreads <= 0)
+		numThreads = (int)thread::hardware_concurrency();
+	g_numThreads = max(1, numThreads);
+}
+
+int NumThreads()
+{
+	return g_numThreads;
+}
+
+
+void ParallelFor(size_t num, int numThreads, const function<void (size_t)>& func)
+{
+	numThreads = t_isWorker ? 1 : (int)min<size_t>(max(1, numThreads), num);
+
+	if(numThreads <= 1){
+		for(size_t i = 0; i < num; ++i)
+			func(i);
+		return;
+	}
+
+	atomic<size_t> nextItem(0);
+	exception_ptr error;
+	mutex m;
+
+	vector<thread> workers;
+	for(int ithread = 0; ithread < numThreads; ++ithread){
+		workers.push_back(thread([&](){
+			t_isWorker = true;
+			try{
+				for(size_t i = nextItem++; i < num; i = nextItem++)
+					func(i);
+			}
+			catch(...){
+				lock_guard<mutex> lock(m);
+				if(!error)
+					error = current_exception();
+				nextItem = num;
+			}
+		}));
+	}
+
+	for(size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+
+	if(error)
+		rethrow_exception(error);
+}
+
+
+bool OrderedPipeline(size_t num, int numThreads, size_t maxAhead,
+					 const function<bool (size_t)>& produce,
+					 const function<void (size_t)>& consume)
+{
+	numThreads = t_isWorker ? 1 : (int)min<size_t>(max(1, numThreads), num);
+	maxAhead = max<size_t>(1, maxAhead);
+
+	if(numThreads <= 1){
+		for(size_t i = 0; i < num; ++i){
+			if(!produce(i))
+				return false;
+			consume(i);
+		}
+		return true;
+	}
+
+	enum State {PENDING, DONE, FAILED};
+	vector<char> state(num, PENDING);
+	size_t nextItem = 0;
+	size_t numConsumed = 0;
+	bool abort = false;
+	exception_ptr error;
+
+	mutex m;
+	condition_variable cond;
+
+	vector<thread> workers;
+	for(int ithread = 0; ithread < numThreads; ++ithread){
+		workers.push_back(thread([&](){
+			t_isWorker = true;
+			for(;;){
+				size_t i;
+				{
+					unique_lock<mutex> lock(m);
+					cond.wait(lock, [&](){
+						return abort || nextItem >= num
+							   || nextItem < numConsumed + maxAhead;});
+					if(abort || nextItem >= num)
+						return;
+					i = nextItem++;
+				}
+
+				bool success = false;
+				try{
+					success = produce(i);
+				}
+				catch(...){
+					lock_guard<mutex> lock(m);
+					if(!error)
+						error = current_exception();
+				}
+
+				{
+					lock_guard<mutex> lock(m);
+					state[i] = success ? DONE : FAILED;
+				}
+				cond.notify_all();
+			}
+		}));
+	}
+
+	bool success = true;
+	try{
+		for(size_t i = 0; i < num; ++i){
+			{
+				unique_lock<mutex> lock(m);
+				cond.wait(lock, [&](){return state[i] != PENDING;});
+				if(state[i] == FAILED){
+					success = false;
+					break;
+				}
+			}
+
+			consume(i);
+
+			{
+				lock_guard<mutex> lock(m);
+				++numConsumed;
+			}
+			cond.notify_all();
+		}
+	}
+	catch(...){
+		lock_guard<mutex> lock(m);
+		if(!error)
+			error = current_exception();
+	}
+
+	{
+		lock_guard<mutex> lock(m);
+		abort = true;
+	}
+	cond.notify_all();
+
+	for(size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+
+	if(error)
+		rethrow_exception(error);
+
+	return success;
+}
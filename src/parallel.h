@@ -0,0 +1,46 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_parallel
+#define __H__ugvec_parallel
+
+#include <cstddef>
+#include <functional>
+
+///	sets the number of threads used by parallel algorithms.
+/**	If numThreads <= 0, the number of hardware threads is used. Default is 1.*/
+void SetNumThreads(int numThreads);
+
+///	returns the number of threads used by parallel algorithms (always >= 1)
+int NumThreads();
+
+
+///	Calls func(i) for all i in [0, num) using up to numThreads threads.
+/**	Indices are handed out to the threads dynamically. Exceptions thrown by
+ * func are rethrown on the calling thread after all threads finished.
+ * If called from a worker thread of ParallelFor or OrderedPipeline, all
+ * items are processed serially on the calling thread.*/
+void ParallelFor(size_t num, int numThreads,
+				 const std::function<void (size_t)>& func);
+
+
+///	Calls produce(i) for all i in [0, num) concurrently and consume(i) in order.
+/**	produce is executed by up to numThreads worker threads, consume is
+ * executed on the calling thread for i = 0, 1, ..., num-1 as soon as the
+ * corresponding produce(i) finished. At most maxAhead items are produced
+ * ahead of the last consumed item.
+ *
+ * If produce(i) returns false, consume is not called for i and any later
+ * item and the function returns false. Exceptions thrown by produce or
+ * consume are rethrown on the calling thread after all workers finished.
+ * Like ParallelFor, the function runs serially if called from a worker thread.*/
+bool OrderedPipeline(size_t num, int numThreads, size_t maxAhead,
+					 const std::function<bool (size_t)>& produce,
+					 const std::function<void (size_t)>& consume);
+
+#endif	//__H__ugvec_parallel
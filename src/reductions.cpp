@@ -0,0 +1,152 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define UGVEC_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+#include "reductions.h"
+
+using namespace std;
+
+///	state of one lane of ComputeNormSums
+struct NormLane{
+	NormLane() : absSum(0), absComp(0), sqSum(0), sqComp(0), maxAbs(0), nan(false)	{}
+	number absSum, absComp;
+	number sqSum, sqComp;
+	number maxAbs;
+	bool nan;	///< true if a nan value was added
+};
+
+///	adds x to a lane. Performs the same operations as the SSE2 loop of ComputeNormSums.
+/**	The compensation is only kept while the sum is finite. Otherwise
+ * (t - sum) - y would evaluate to inf - inf = nan for an infinite sum t.*/
+static inline void AddToLane(NormLane& l, number x)
+{
+	const number inf = numeric_limits<number>::infinity();
+	const number a = fabs(x);
+	number y = a - l.absComp;
+	number t = l.absSum + y;
+	l.absComp = (fabs(t) < inf) ? (t - l.absSum) - y : 0;
+	l.absSum = t;
+
+	y = x * x - l.sqComp;
+	t = l.sqSum + y;
+	l.sqComp = (fabs(t) < inf) ? (t - l.sqSum) - y : 0;
+	l.sqSum = t;
+
+//	same semantics as _mm_max_pd
+	l.maxAbs = (l.maxAbs > a) ? l.maxAbs : a;
+	l.nan = l.nan || (x != x);
+}
+
+
+NormSums ComputeNormSums(const number* data, size_t num)
+{
+	NormLane lanes[4];
+	size_t i = 0;
+
+#ifdef UGVEC_SSE2
+	{
+		const __m128d signMask = _mm_set1_pd(-0.);
+		const __m128d inf = _mm_set1_pd(numeric_limits<number>::infinity());
+		__m128d absSum[2], absComp[2], sqSum[2], sqComp[2], maxAbs[2], nan[2];
+		for(int j = 0; j < 2; ++j)
+			absSum[j] = absComp[j] = sqSum[j] = sqComp[j] = maxAbs[j] = nan[j] = _mm_setzero_pd();
+
+		for(; i + 4 <= num; i += 4){
+			for(int j = 0; j < 2; ++j){
+				const __m128d x = _mm_loadu_pd(data + i + 2 * j);
+				const __m128d a = _mm_andnot_pd(signMask, x);
+
+			//	compensations are reset to 0 in lanes whose sum isn't finite (see AddToLane)
+				__m128d y = _mm_sub_pd(a, absComp[j]);
+				__m128d t = _mm_add_pd(absSum[j], y);
+				absComp[j] = _mm_and_pd(_mm_cmplt_pd(_mm_andnot_pd(signMask, t), inf),
+										_mm_sub_pd(_mm_sub_pd(t, absSum[j]), y));
+				absSum[j] = t;
+
+				y = _mm_sub_pd(_mm_mul_pd(x, x), sqComp[j]);
+				t = _mm_add_pd(sqSum[j], y);
+				sqComp[j] = _mm_and_pd(_mm_cmplt_pd(_mm_andnot_pd(signMask, t), inf),
+									   _mm_sub_pd(_mm_sub_pd(t, sqSum[j]), y));
+				sqSum[j] = t;
+
+				maxAbs[j] = _mm_max_pd(maxAbs[j], a);
+				nan[j] = _mm_or_pd(nan[j], _mm_cmpunord_pd(x, x));
+			}
+		}
+
+		for(int j = 0; j < 2; ++j){
+			double tmp[5][2];
+			_mm_storeu_pd(tmp[0], absSum[j]);
+			_mm_storeu_pd(tmp[1], absComp[j]);
+			_mm_storeu_pd(tmp[2], sqSum[j]);
+			_mm_storeu_pd(tmp[3], sqComp[j]);
+			_mm_storeu_pd(tmp[4], maxAbs[j]);
+			const int nanMask = _mm_movemask_pd(nan[j]);
+			for(int k = 0; k < 2; ++k){
+				NormLane& l = lanes[2 * j + k];
+				l.absSum = tmp[0][k];
+				l.absComp = tmp[1][k];
+				l.sqSum = tmp[2][k];
+				l.sqComp = tmp[3][k];
+				l.maxAbs = tmp[4][k];
+				l.nan = (nanMask >> k) & 1;
+			}
+		}
+	}
+#else
+	for(; i + 4 <= num; i += 4){
+		for(int j = 0; j < 4; ++j)
+			AddToLane(lanes[j], data[i + j]);
+	}
+#endif
+
+	for(size_t j = 0; i < num; ++i, ++j)
+		AddToLane(lanes[j], data[i]);
+
+	NormSums s;
+	s.absSum = ((lanes[0].absSum - lanes[0].absComp) + (lanes[1].absSum - lanes[1].absComp))
+			 + ((lanes[2].absSum - lanes[2].absComp) + (lanes[3].absSum - lanes[3].absComp));
+	s.sqSum = ((lanes[0].sqSum - lanes[0].sqComp) + (lanes[1].sqSum - lanes[1].sqComp))
+			+ ((lanes[2].sqSum - lanes[2].sqComp) + (lanes[3].sqSum - lanes[3].sqComp));
+	s.maxAbs = max(max(lanes[0].maxAbs, lanes[1].maxAbs), max(lanes[2].maxAbs, lanes[3].maxAbs));
+
+//	max drops nan values, while they propagate to the sums
+	if(lanes[0].nan || lanes[1].nan || lanes[2].nan || lanes[3].nan)
+		s.maxAbs = numeric_limits<number>::quiet_NaN();
+	return s;
+}
+
+
+NormSums PairwiseSum(const NormSums* begin, const NormSums* end)
+{
+	const size_t num = end - begin;
+	if(num == 0)
+		return NormSums();
+	if(num == 1)
+		return *begin;
+
+	const NormSums* mid = begin + num / 2;
+	const NormSums s1 = PairwiseSum(begin, mid);
+	const NormSums s2 = PairwiseSum(mid, end);
+
+	NormSums s;
+	s.absSum = s1.absSum + s2.absSum;
+	s.sqSum = s1.sqSum + s2.sqSum;
+	if(std::isnan(s1.maxAbs) || std::isnan(s2.maxAbs))
+		s.maxAbs = numeric_limits<number>::quiet_NaN();
+	else
+		s.maxAbs = max(s1.maxAbs, s2.maxAbs);
+	return s;
+}
@@ -0,0 +1,39 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_reductions
+#define __H__ugvec_reductions
+
+#include <cstddef>
+#include <vector>
+#include "ugvec_types.h"
+
+///	sums and maximum of the absolute values and the squares of an array
+struct NormSums{
+	NormSums() : absSum(0), sqSum(0), maxAbs(0)	{}
+
+	number	absSum;		///< sum of |x_i|
+	number	sqSum;		///< sum of x_i^2
+	number	maxAbs;		///< max |x_i|. nan if any x_i is nan.
+};
+
+
+///	computes the NormSums of num values in a single pass
+/**	The values are processed in 4 lanes (through SSE2 if available), each of
+ * which uses Kahan summation. The lanes are combined pairwise at the end.
+ * The result doesn't depend on whether SSE2 is used. For accurate results on
+ * huge arrays, apply this function to blocks of a few thousand values and
+ * combine the results through PairwiseSum.
+ * Infinite values and sums which overflow lead to infinite sums, nan values
+ * to nan in all members.*/
+NormSums ComputeNormSums(const number* data, size_t num);
+
+///	adds the sums of the entries in [begin, end) through pairwise summation
+NormSums PairwiseSum(const NormSums* begin, const NormSums* end);
+
+#endif	//__H__ugvec_reductions
@@ -0,0 +1,213 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "algebraic_vector.h"
+#include "file_io.h"
+#include "parallel.h"
+#include "series.h"
+#include "text_writer.h"
+#include "ugvec_base.h"
+#include "vec_tools.h"
+
+using namespace std;
+
+///	returns true if pattern contains exactly one conversion of the form %d, %5d or %05d and no other '%'
+static bool IsValidPattern(const char* pattern, bool& hasConversion)
+{
+	hasConversion = false;
+	for(const char* p = pattern; *p; ++p){
+		if(*p != '%')
+			continue;
+		if(hasConversion)
+			return false;
+		++p;
+		while(isdigit(*p))
+			++p;
+		if(*p != 'd')
+			return false;
+		hasConversion = true;
+	}
+	return true;
+}
+
+
+static string ExpandPattern(const char* pattern, int step)
+{
+	char name[4096];
+	snprintf(name, sizeof(name), pattern, step);
+	return string(name);
+}
+
+
+static bool FileExists(const string& filename)
+{
+	ifstream in(filename.c_str());
+	return in.good();
+}
+
+
+namespace{
+///	results of the comparison of one step
+struct StepResult{
+	vector<ComponentStatistics>	stats;
+	vector<ComponentNorms>		norms;
+	vector<ComponentNorms>		refNorms;
+};
+}
+
+
+bool RunSeries(const char* pattern1, const char* pattern2, const char* tableFile,
+			   int first, int last, bool makeConsistent, int component,
+			   bool canonical)
+{
+	bool hasConv1, hasConv2;
+	if(!IsValidPattern(pattern1, hasConv1) || !hasConv1
+	   || !IsValidPattern(pattern2, hasConv2))
+	{
+		LOG("ERROR -- Invalid file pattern. Patterns have to contain a single"
+			" integer conversion like %d or %04d: " << pattern1 << ", " << pattern2 << endl);
+		return false;
+	}
+
+//	collect the steps whose files exist
+	vector<int> steps;
+	for(int step = first; last < 0 || step <= last; ++step){
+		if(!FileExists(ExpandPattern(pattern1, step))
+		   || (hasConv2 && !FileExists(ExpandPattern(pattern2, step))))
+		{
+			if(last >= 0){
+				LOG("ERROR -- Missing files of step " << step << endl);
+				return false;
+			}
+			break;
+		}
+		steps.push_back(step);
+	}
+
+	if(steps.empty()){
+		LOG("ERROR -- No files found for step " << first << endl);
+		return false;
+	}
+
+//	a reference without a conversion is loaded only once
+	AlgebraicVector fixedRef;
+	if(!hasConv2){
+		if(!LoadVector(fixedRef, pattern2, makeConsistent, component))
+			return false;
+		if(canonical)
+			fixedRef.sort_canonical();
+	}
+
+	ofstream tableStream;
+	ostream* table = &cout;
+	if(tableFile){
+		tableStream.open(tableFile);
+		if(!tableStream){
+			LOG("ERROR -- File can not be opened for write: " << tableFile << endl);
+			return false;
+		}
+		table = &tableStream;
+	}
+
+	vector<StepResult> results(steps.size());
+	TextBuffer row;
+	size_t numHeaderComps = 0;
+
+//	at least two threads are used, so that loading the next steps overlaps
+//	with the comparison of the current one
+	const int numThreads = max(2, NumThreads());
+
+	const bool success = OrderedPipeline(steps.size(), numThreads, numThreads,
+		[&](size_t i){
+			AlgebraicVector av1, av2;
+			if(!LoadVector(av1, ExpandPattern(pattern1, steps[i]).c_str(),
+						   makeConsistent, component))
+			{
+				return false;
+			}
+			if(hasConv2){
+				if(!LoadVector(av2, ExpandPattern(pattern2, steps[i]).c_str(),
+							   makeConsistent, component))
+				{
+					return false;
+				}
+			}
+			if(canonical){
+				av1.sort_canonical();
+				av2.sort_canonical();
+			}
+
+			StepResult& res = results[i];
+			ComputeNorms(res.refNorms, av1);
+			av1.subtract_vector(hasConv2 ? av2 : fixedRef);
+			ComputeStatistics(res.stats, av1);
+			ComputeNorms(res.norms, res.stats);
+			return true;
+		},
+		[&](size_t i){
+			StepResult& res = results[i];
+			row.clear();
+			if(i == 0){
+				numHeaderComps = res.stats.size();
+				row.append("step");
+				for(size_t ci = 0; ci < numHeaderComps; ++ci){
+					static const char* columns[] = {"min", "max", "L1", "L2", "Linf", "relL2"};
+					for(size_t j = 0; j < 6; ++j){
+						row.append("\tc");
+						row.append_uint(ci);
+						row.append('.');
+						row.append(columns[j]);
+					}
+				}
+				row.append('\n');
+			}
+
+		//	the columns are fixed by the header. Missing components are
+		//	written as nan, additional components are dropped.
+			if(res.stats.size() != numHeaderComps){
+				LOG("  -> WARNING: step " << steps[i] << " has " << res.stats.size()
+					<< " components instead of " << numHeaderComps << endl);
+			}
+
+			row.append_int(steps[i]);
+			for(size_t ci = 0; ci < numHeaderComps; ++ci){
+				if(ci >= res.stats.size()){
+					for(size_t j = 0; j < 6; ++j)
+						row.append("\tnan");
+					continue;
+				}
+
+				const ComponentStatistics& s = res.stats[ci];
+				const ComponentNorms& n = res.norms[ci];
+				const number values[] = {s.numEntries > 0 ? s.minVal : 0,
+										 s.numEntries > 0 ? s.maxVal : 0,
+										 n.l1, n.l2, n.linf,
+										 ci < res.refNorms.size() ? n.l2 / res.refNorms[ci].l2 : n.l2 / 0.};
+				for(size_t j = 0; j < 6; ++j){
+					row.append('\t');
+					row.append_number(values[j]);
+				}
+			}
+			row.append('\n');
+			table->write(row.data(), row.size());
+			table->flush();
+			results[i] = StepResult();
+		});
+
+	if(!success)
+		LOG("ERROR -- Comparison of the series stopped, since a file couldn't be loaded." << endl);
+	return success;
+}
@@ -0,0 +1,34 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_series
+#define __H__ugvec_series
+
+///	compares the time steps of two series of vectors and writes a table with one row per step
+/**	pattern1 and pattern2 contain a printf-style integer conversion (e.g.
+ * 'sol_%04d.pvec'), which is replaced by the step. If pattern2 contains no
+ * conversion, all steps are compared against the same vector, which is
+ * loaded only once.
+ *
+ * Steps first, first+1, ... are compared until 'last' (if last >= 0) or
+ * until a file is missing. For each step, the min/max and the L1, L2 and
+ * Linf norms of each component of v1 - v2 are computed, together with the
+ * L2 norm relative to v1.
+ *
+ * Steps are processed through an OrderedPipeline with at least two
+ * threads, so that the next steps are loaded while a step is compared.
+ * The rows are written in order, tab separated, to tableFile or to cout if
+ * tableFile is NULL. The number of components of the first step determines
+ * the columns. If a later step has fewer components, the missing columns are
+ * nan. Additional components are dropped with a warning.
+ * Returns false if a pattern is invalid or a file can't be loaded.*/
+bool RunSeries(const char* pattern1, const char* pattern2, const char* tableFile,
+			   int first, int last, bool makeConsistent, int component,
+			   bool canonical);
+
+#endif	//__H__ugvec_series
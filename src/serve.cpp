@@ -0,0 +1,399 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+	#include <cerrno>
+	#include <csignal>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+#include "algebraic_vector.h"
+#include "file_io.h"
+#include "serve.h"
+#include "ugvec_base.h"
+#include "vec_tools.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+namespace{
+
+///	modification time and size of a file
+struct FileStamp{
+	FileStamp() : sec(0), nsec(0), size(0)	{}
+	bool operator==(const FileStamp& s) const	{return sec == s.sec && nsec == s.nsec && size == s.size;}
+
+	int64_t sec;
+	int64_t nsec;
+	int64_t size;
+};
+
+
+bool GetFileStamp(FileStamp& stampOut, const char* filename)
+{
+	struct stat st;
+	if(stat(filename, &st) != 0)
+		return false;
+	stampOut.sec = st.st_mtime;
+	#ifdef __APPLE__
+		stampOut.nsec = st.st_mtimespec.tv_nsec;
+	#else
+		stampOut.nsec = st.st_mtim.tv_nsec;
+	#endif
+	stampOut.size = st.st_size;
+	return true;
+}
+
+
+///	vectors which were loaded by earlier requests
+class VectorCache{
+	public:
+		explicit VectorCache(bool canonical) : m_canonical(canonical)	{}
+
+	///	returns the cached vector or loads it, if the file changed since it was cached
+	/**	Returns an empty pointer if the file can't be loaded.*/
+		shared_ptr<const AlgebraicVector>
+		get(const string& filename, bool makeConsistent, int component)
+		{
+			FileStamp stamp;
+			if(!GetFileStamp(stamp, filename.c_str())){
+				LOG("ERROR -- File not found: " << filename << endl);
+				return shared_ptr<const AlgebraicVector>();
+			}
+
+			ostringstream key;
+			key << filename << '\n' << makeConsistent << '\n' << component;
+
+			Entry& e = m_entries[key.str()];
+			if(e.av && e.stamp == stamp){
+				LOG("INFO -- using cached vector from " << filename << endl);
+				return e.av;
+			}
+
+			e.av.reset();
+			shared_ptr<AlgebraicVector> av(new AlgebraicVector);
+			if(!LoadVector(*av, filename.c_str(), makeConsistent, component)){
+				m_entries.erase(key.str());
+				return shared_ptr<const AlgebraicVector>();
+			}
+			if(m_canonical)
+				av->sort_canonical();
+
+			e.stamp = stamp;
+			e.av = av;
+			return e.av;
+		}
+
+		void clear()	{m_entries.clear();}
+
+	private:
+		struct Entry{
+			FileStamp							stamp;
+			shared_ptr<const AlgebraicVector>	av;
+		};
+
+		map<string, Entry>	m_entries;
+		bool				m_canonical;
+};
+
+
+///	executes a single request and writes its output to 'out'. Returns false on failure.
+bool ExecuteRequest(const vector<string>& tokens, VectorCache& cache, ostream& out)
+{
+	const string& command = tokens[0];
+
+	bool	makeCons	= true;
+	int		component	= -1;
+	int		histoSecs	= 5;
+	bool	histoAbs	= false;
+	bool	histoLog	= false;
+	bool	verbose		= false;
+	bool	printNorms	= false;
+	int		numNeighbours = 1;
+	vector<string> file;
+
+	for(size_t i = 1; i < tokens.size(); ++i){
+		const string& t = tokens[i];
+		if(t == "-consistent")
+			makeCons = false;
+		else if(t == "-histoAbs")
+			histoAbs = true;
+		else if(t == "-histoLog"){
+			histoLog = true;
+			histoAbs = true;
+		}
+		else if(t == "-verbose")
+			verbose = true;
+		else if(t == "-norms")
+			printNorms = true;
+		else if((t == "-component" || t == "-histoSecs" || t == "-idw") && i + 1 < tokens.size()){
+			const int val = atoi(tokens[++i].c_str());
+			if(t == "-component")
+				component = val;
+			else if(t == "-histoSecs")
+				histoSecs = val;
+			else
+				numNeighbours = val;
+		}
+		else if(!t.empty() && t[0] == '-'){
+			out << "ERROR -- Invalid option supplied: " << t << endl;
+			return false;
+		}
+		else
+			file.push_back(t);
+	}
+
+	size_t minFiles = 1, maxFiles = 1;
+	if(command == "process" || command == "histogram")
+		minFiles = maxFiles = 2;
+	else if(command == "dif" || command == "compare-nn")
+		minFiles = maxFiles = 3;
+	else if(command == "norms")
+		maxFiles = 2;
+	else if(command != "minmax" && command != "info"){
+		out << "ERROR -- Unknown command: " << command << endl;
+		return false;
+	}
+
+	if(file.size() < minFiles || file.size() > maxFiles){
+		out << "ERROR -- Wrong number of files for " << command << endl;
+		return false;
+	}
+
+//	the last file of process, histogram, dif and compare-nn is written
+	const size_t numIn = (minFiles == maxFiles && minFiles > 1) ? file.size() - 1 : file.size();
+	vector<shared_ptr<const AlgebraicVector> > in;
+	for(size_t i = 0; i < numIn; ++i){
+		in.push_back(cache.get(file[i], makeCons, component));
+		if(!in.back()){
+			out << "ERROR -- Couldn't load " << file[i] << endl;
+			return false;
+		}
+	}
+
+	if(verbose){
+		for(size_t i = 0; i < in.size(); ++i){
+			out << "Properties of " << file[i] << ":\n";
+			PrintInfo(*in[i], NULL, out);
+		}
+	}
+
+	bool success = true;
+	if(command == "process")
+		success = SaveVector(*in[0], file[1].c_str());
+
+	else if(command == "dif" || command == "compare-nn"){
+		vector<ComponentNorms> refNorms;
+		AlgebraicVector difVec;
+		if(command == "dif"){
+			if(printNorms)
+				ComputeNorms(refNorms, *in[0]);
+			difVec = *in[0];
+			difVec.subtract_vector(*in[1]);
+		}
+		else if(!InterpolatedDifference(difVec, *in[0], *in[1], numNeighbours, out)){
+			out << "ERROR -- Vectors can't be compared." << endl;
+			return false;
+		}
+
+		vector<ComponentStatistics> stats;
+		ComputeStatistics(stats, difVec);
+		success = SaveVector(difVec, file[2].c_str());
+		PrintMinMax(difVec, &stats, out);
+
+		if(printNorms && command == "dif"){
+			vector<ComponentNorms> norms;
+			ComputeNorms(norms, stats);
+			out << "Norms of v1-v2 (relative to v1):" << endl;
+			PrintNorms(norms, &refNorms, out);
+		}
+	}
+
+	else if(command == "norms"){
+		vector<ComponentNorms> norms;
+		ComputeNorms(norms, *in[0]);
+		if(in.size() == 2){
+			AlgebraicVector difVec(*in[0]);
+			difVec.subtract_vector(*in[1]);
+			vector<ComponentNorms> refNorms;
+			refNorms.swap(norms);
+			ComputeNorms(norms, difVec);
+			out << "Norms of v1-v2 (relative to v1):" << endl;
+			PrintNorms(norms, &refNorms, out);
+		}
+		else
+			PrintNorms(norms, NULL, out);
+	}
+
+	else{
+		vector<ComponentStatistics> stats;
+		ComputeStatistics(stats, *in[0]);
+		if(command == "minmax")
+			PrintMinMax(*in[0], &stats, out);
+		else if(command == "info")
+			PrintInfo(*in[0], &stats, out);
+		else{
+			success = SaveHistogramToUGX(*in[0], file[1].c_str(), histoSecs,
+										 histoAbs, histoLog, &stats, out);
+		}
+	}
+
+	if(!success)
+		out << "ERROR -- Couldn't write " << file.back() << endl;
+	return success;
+}
+
+
+bool SendAll(int conn, const string& data)
+{
+	size_t pos = 0;
+	while(pos < data.size()){
+		const ssize_t num = send(conn, data.data() + pos, data.size() - pos, 0);
+		if(num < 0){
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		pos += num;
+	}
+	return true;
+}
+
+}//	end of anonymous namespace
+
+
+bool RunServer(const char* socketPath, bool canonical)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(socketPath) >= sizeof(addr.sun_path)){
+		LOG("ERROR -- Socket path is too long: " << socketPath << endl);
+		return false;
+	}
+	strcpy(addr.sun_path, socketPath);
+
+//	a socket left over by an earlier server is replaced, but no other file
+	struct stat st;
+	if(lstat(socketPath, &st) == 0){
+		if(!S_ISSOCK(st.st_mode)){
+			LOG("ERROR -- File exists and is not a socket: " << socketPath << endl);
+			return false;
+		}
+		unlink(socketPath);
+	}
+
+	const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(sock < 0
+	   || bind(sock, (const sockaddr*)&addr, sizeof(addr)) != 0
+	   || listen(sock, 16) != 0)
+	{
+		LOG("ERROR -- Couldn't listen on socket " << socketPath << ": " << strerror(errno) << endl);
+		if(sock >= 0)
+			close(sock);
+		return false;
+	}
+
+//	clients which disconnect early must not terminate the server
+	signal(SIGPIPE, SIG_IGN);
+
+	LOG("INFO -- listening on " << socketPath << endl);
+
+	VectorCache cache(canonical);
+	bool quit = false;
+	while(!quit){
+		const int conn = accept(sock, NULL, NULL);
+		if(conn < 0){
+			if(errno == EINTR)
+				continue;
+			LOG("ERROR -- accept failed: " << strerror(errno) << endl);
+			break;
+		}
+
+		string pending;
+		char chunk[4096];
+		bool connected = true;
+		while(connected && !quit){
+			const ssize_t num = recv(conn, chunk, sizeof(chunk), 0);
+			if(num < 0 && errno == EINTR)
+				continue;
+			if(num <= 0){
+			//	a last request may lack the line break
+				connected = false;
+				pending += '\n';
+			}
+			else
+				pending.append(chunk, num);
+
+			size_t lineEnd;
+			while(!quit && (lineEnd = pending.find('\n')) != string::npos){
+				const string line = pending.substr(0, lineEnd);
+				pending.erase(0, lineEnd + 1);
+
+				istringstream ss(line);
+				vector<string> tokens;
+				string t;
+				while(ss >> t)
+					tokens.push_back(t);
+				if(tokens.empty())
+					continue;
+
+				LOG("INFO -- request: " << line << endl);
+				ostringstream out;
+				bool success = true;
+				if(tokens[0] == "quit")
+					quit = true;
+				else if(tokens[0] == "clear")
+					cache.clear();
+				else{
+					try{
+						success = ExecuteRequest(tokens, cache, out);
+					}
+					catch(...){
+						success = false;
+					}
+				}
+
+				out << (success ? "== ok" : "== error") << endl;
+				if(!SendAll(conn, out.str())){
+					pending.clear();
+					connected = false;
+				}
+			}
+		}
+		close(conn);
+	}
+
+	close(sock);
+	unlink(socketPath);
+	return true;
+}
+
+#else
+
+bool RunServer(const char* socketPath, bool canonical)
+{
+	LOG("ERROR -- serve is not supported on this platform." << endl);
+	return false;
+}
+
+#endif
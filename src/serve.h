@@ -0,0 +1,35 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_serve
+#define __H__ugvec_serve
+
+///	answers requests on a Unix domain socket and keeps loaded vectors resident
+/**	Clients connect to 'socketPath' and send one request per line, e.g.
+ *
+ *	minmax sol.pvec -component 1
+ *	dif a.vec b.pvec dif.vec -norms
+ *
+ * Requests take the same commands, files and options as ugvec itself
+ * (process, dif, norms, compare-nn, minmax, histogram, info). Options which
+ * affect loading or merging (-threads, -tol, -canonical) are taken from the
+ * server's command line. The output of each request is sent back, followed
+ * by a line '== ok' or '== error'. The request 'clear' drops all cached
+ * vectors and 'quit' stops the server.
+ *
+ * Loaded vectors are cached by file name, storage type and component. A
+ * cached vector is reloaded if the modification time or size of its file
+ * changed. For parallel vectors only the header file (.pvec, .pvtu) is
+ * checked. Relative file names are resolved against the server's working
+ * directory.
+ *
+ * Requests are processed one after another, each one using NumThreads()
+ * threads (see parallel.h). Returns false if the socket can't be set up.*/
+bool RunServer(const char* socketPath, bool canonical);
+
+#endif	//__H__ugvec_serve
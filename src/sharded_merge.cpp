@@ -0,0 +1,264 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <limits>
+
+#include "parallel.h"
+#include "sharded_merge.h"
+#include "ugvec_base.h"
+
+using namespace std;
+
+static const uint16_t NO_SHARD = numeric_limits<uint16_t>::max();
+
+
+///	Calls assign(s, j, g) for the j-th key of each shard s, where g is the rank of that key among all keys.
+/**	All keys have to be unique and smaller than keySpace and the keys of each
+ * shard have to be sorted ascendingly. The key space is processed in chunks
+ * in parallel.*/
+template <class TAssign>
+static void
+AssignByKeys(const vector<const vector<uint64_t>*>& keys, uint64_t keySpace,
+			 TAssign assign)
+{
+	const size_t numShards = keys.size();
+	const int numThreads = NumThreads();
+
+	vector<uint16_t> owner(keySpace, NO_SHARD);
+	ParallelFor(numShards, numThreads, [&](size_t s){
+		const vector<uint64_t>& k = *keys[s];
+		for(size_t j = 0; j < k.size(); ++j)
+			owner[k[j]] = (uint16_t)s;
+	});
+
+	const size_t numChunks = (size_t)min<uint64_t>(max<uint64_t>(keySpace, 1),
+												   4 * numThreads);
+	const uint64_t chunkSize = (keySpace + numChunks - 1) / numChunks;
+
+//	firstInChunk[c * numShards + s]: index of the first key of shard s in chunk c
+	vector<size_t> firstInChunk((numChunks + 1) * numShards);
+	ParallelFor(numShards, numThreads, [&](size_t s){
+		const vector<uint64_t>& k = *keys[s];
+		for(size_t c = 0; c <= numChunks; ++c){
+			firstInChunk[c * numShards + s] =
+				lower_bound(k.begin(), k.end(), c * chunkSize) - k.begin();
+		}
+	});
+
+	vector<size_t> chunkBase(numChunks + 1, 0);
+	for(size_t c = 0; c < numChunks; ++c){
+		size_t num = 0;
+		for(size_t s = 0; s < numShards; ++s)
+			num += firstInChunk[(c + 1) * numShards + s] - firstInChunk[c * numShards + s];
+		chunkBase[c + 1] = chunkBase[c] + num;
+	}
+
+	ParallelFor(numChunks, numThreads, [&](size_t c){
+		vector<size_t> cursor(firstInChunk.begin() + c * numShards,
+							  firstInChunk.begin() + (c + 1) * numShards);
+		size_t g = chunkBase[c];
+		const uint64_t end = min<uint64_t>((c + 1) * chunkSize, keySpace);
+		for(uint64_t k = c * chunkSize; k < end; ++k){
+			const uint16_t s = owner[k];
+			if(s != NO_SHARD)
+				assign(s, cursor[s]++, g++);
+		}
+	});
+}
+
+
+ShardedMerge::
+ShardedMerge(int numShards, bool addValues) :
+	m_shards(min<int>(max(1, numShards), NO_SHARD)),
+	m_addValues(addValues),
+	m_worldDim(0),
+	m_numNodeKeys(0)
+{
+}
+
+
+int ShardedMerge::
+shard_of(const Node& n) const
+{
+//	use the high bits of the hash, since the low bits select the slots of NodeHashIndex
+	return (int)(((uint64_t)NodeHashIndex::hash(n) * m_shards.size()) >> 32);
+}
+
+
+void ShardedMerge::
+prepare(ShardedPiece& piece) const
+{
+	const AlgebraicVector& av = piece.av;
+	const size_t numShards = m_shards.size();
+
+//	counting sort of nodes and entries by shard
+	vector<uint16_t> nodeShard(av.nodes.size());
+	piece.nodeShardBegin.assign(numShards + 1, 0);
+	for(size_t i = 0; i < av.nodes.size(); ++i){
+		nodeShard[i] = (uint16_t)shard_of(av.nodes[i]);
+		++piece.nodeShardBegin[nodeShard[i] + 1];
+	}
+
+	for(size_t s = 0; s < numShards; ++s)
+		piece.nodeShardBegin[s + 1] += piece.nodeShardBegin[s];
+
+	vector<size_t> cursor(piece.nodeShardBegin.begin(), piece.nodeShardBegin.end() - 1);
+	piece.nodeOrder.resize(av.nodes.size());
+	for(size_t i = 0; i < av.nodes.size(); ++i)
+		piece.nodeOrder[cursor[nodeShard[i]]++] = (uint)i;
+
+	piece.entryOrder.resize(av.comps.size());
+	piece.entryShardBegin.resize(av.comps.size());
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const Array<uint>& compNodes = av.comps[ci].nodes;
+		vector<size_t>& shardBegin = piece.entryShardBegin[ci];
+		shardBegin.assign(numShards + 1, 0);
+		for(size_t i = 0; i < compNodes.size(); ++i)
+			++shardBegin[nodeShard[compNodes[i]] + 1];
+
+		for(size_t s = 0; s < numShards; ++s)
+			shardBegin[s + 1] += shardBegin[s];
+
+		cursor.assign(shardBegin.begin(), shardBegin.end() - 1);
+		vector<uint>& order = piece.entryOrder[ci];
+		order.resize(compNodes.size());
+		for(size_t i = 0; i < compNodes.size(); ++i)
+			order[cursor[nodeShard[compNodes[i]]]++] = (uint)i;
+	}
+}
+
+
+void ShardedMerge::
+merge(const ShardedPiece& piece)
+{
+	const AlgebraicVector& av = piece.av;
+
+	if(m_worldDim == 0)
+		m_worldDim = av.worldDim;
+	else if(m_worldDim != av.worldDim){
+		LOG("ERROR -- Can't merge vectors with different world dimensions!" << std::endl);
+		return;
+	}
+
+	CHECK(piece.nodeShardBegin.size() == m_shards.size() + 1,
+		  "ShardedMerge::merge: piece was not prepared.");
+
+	if(m_numEntryKeys.size() < av.comps.size())
+		m_numEntryKeys.resize(av.comps.size(), 0);
+
+	m_pieceToShard.resize(av.nodes.size());
+
+	ParallelFor(m_shards.size(), NumThreads(), [&](size_t s){
+		Shard& shard = m_shards[s];
+		AlgebraicVector& sav = shard.av;
+		sav.worldDim = m_worldDim;
+
+		for(size_t k = piece.nodeShardBegin[s]; k < piece.nodeShardBegin[s + 1]; ++k){
+			const uint i = piece.nodeOrder[k];
+			const uint newInd = (uint)sav.nodes.size();
+			const uint ind = shard.index.nodeIndex.find_or_insert(av.nodes[i], newInd, sav.nodes);
+			if(ind == newInd){
+				sav.add_node(av.nodes[i]);
+				shard.nodeKeys.push_back(m_numNodeKeys + i);
+			}
+			m_pieceToShard[i] = ind;
+		}
+
+		if(sav.comps.size() < av.comps.size()){
+			sav.comps.resize(av.comps.size());
+			shard.index.entryMap.resize(av.comps.size());
+			shard.entryKeys.resize(av.comps.size());
+		}
+
+		for(size_t ci = 0; ci < av.comps.size(); ++ci){
+			const Component& comp = av.comps[ci];
+			const vector<uint>& order = piece.entryOrder[ci];
+			const vector<size_t>& shardBegin = piece.entryShardBegin[ci];
+			Component& scomp = sav.comps[ci];
+			vector<uint>& entryMap = shard.index.entryMap[ci];
+			entryMap.resize(sav.nodes.size(), MergeIndex::INVALID);
+
+			for(size_t k = shardBegin[s]; k < shardBegin[s + 1]; ++k){
+				const uint i = order[k];
+				const uint node = m_pieceToShard[comp.nodes[i]];
+				uint& entry = entryMap[node];
+				if(entry == MergeIndex::INVALID){
+					entry = (uint)scomp.data.size();
+					scomp.nodes.push_back(node);
+					scomp.data.push_back(comp.data[i]);
+					shard.entryKeys[ci].push_back(m_numEntryKeys[ci] + i);
+				}
+				else if(m_addValues)
+					scomp.data[entry] += comp.data[i];
+			}
+		}
+	});
+
+	m_numNodeKeys += av.nodes.size();
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		m_numEntryKeys[ci] += av.comps[ci].data.size();
+}
+
+
+void ShardedMerge::
+assemble(AlgebraicVector& av)
+{
+	const size_t numShards = m_shards.size();
+
+	av.clear();
+	av.worldDim = m_worldDim;
+
+//	nodes
+	vector<vector<uint> > shardToGlobal(numShards);
+	vector<const vector<uint64_t>*> keys(numShards);
+	size_t numNodes = 0;
+	for(size_t s = 0; s < numShards; ++s){
+		shardToGlobal[s].resize(m_shards[s].av.nodes.size());
+		keys[s] = &m_shards[s].nodeKeys;
+		numNodes += m_shards[s].av.nodes.size();
+	}
+
+	CHECK(numNodes < (size_t)numeric_limits<uint>::max(),
+		  "Too many nodes in AlgebraicVector.");
+	av.nodes.resize(numNodes);
+
+	AssignByKeys(keys, m_numNodeKeys, [&](size_t s, size_t j, size_t g){
+		av.nodes[g] = m_shards[s].av.nodes[j];
+		shardToGlobal[s][j] = (uint)g;
+	});
+
+//	entries. Shards which don't have a component are skipped through empty keys.
+	const vector<uint64_t> noKeys;
+	av.comps.resize(m_numEntryKeys.size());
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		size_t numEntries = 0;
+		for(size_t s = 0; s < numShards; ++s){
+			if(ci < m_shards[s].av.comps.size()){
+				keys[s] = &m_shards[s].entryKeys[ci];
+				numEntries += m_shards[s].av.comps[ci].data.size();
+			}
+			else
+				keys[s] = &noKeys;
+		}
+
+		Component& comp = av.comps[ci];
+		comp.nodes.resize(numEntries);
+		comp.data.resize(numEntries);
+
+		AssignByKeys(keys, m_numEntryKeys[ci], [&](size_t s, size_t j, size_t g){
+			const Component& scomp = m_shards[s].av.comps[ci];
+			comp.nodes[g] = shardToGlobal[s][scomp.nodes[j]];
+			comp.data[g] = scomp.data[j];
+		});
+	}
+
+	vector<Shard>(numShards).swap(m_shards);
+	m_numNodeKeys = 0;
+	m_numEntryKeys.clear();
+}
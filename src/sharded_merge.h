@@ -0,0 +1,83 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_sharded_merge
+#define __H__ugvec_sharded_merge
+
+#include <vector>
+#include <stdint.h>
+#include "algebraic_vector.h"
+#include "merge_index.h"
+#include "ugvec_base.h"
+
+///	A piece of a parallel vector whose nodes and entries are sorted by shards
+/**	Use ShardedMerge::prepare to fill the members besides 'av'.*/
+struct ShardedPiece{
+	AlgebraicVector	av;
+
+///	indices of av.nodes sorted by shard. Shard s: [nodeShardBegin[s], nodeShardBegin[s+1])
+	std::vector<uint>					nodeOrder;
+	std::vector<size_t>					nodeShardBegin;
+
+///	for each component the entry indices sorted by the shard of their nodes
+	std::vector<std::vector<uint> >		entryOrder;
+	std::vector<std::vector<size_t> >	entryShardBegin;
+};
+
+
+///	Merges pieces of a parallel vector using several threads.
+/**	Nodes are distributed to shards by their hash value. Each shard has its
+ * own index and is merged by its own thread, so merging a piece scales with
+ * the number of threads. 'assemble' combines the shards into one vector in
+ * parallel.
+ *
+ * Pieces have to be merged in order. Since all entries of a node end up in
+ * the same shard, values are added (or ignored) in the same order as by
+ * AlgebraicVector::add_vector (or unite_with_vector). Besides, 'assemble'
+ * orders nodes and entries by their first occurrence in the merged pieces.
+ * The result is thus identical to consecutive calls to add_vector (or
+ * unite_with_vector) on an initially empty vector, regardless of the number
+ * of shards.*/
+class ShardedMerge{
+	public:
+		ShardedMerge(int numShards, bool addValues);
+
+	///	sorts nodes and entries of piece.av by shards.
+	/**	This method may be called concurrently for different pieces.*/
+		void prepare(ShardedPiece& piece) const;
+
+	///	merges a prepared piece. Shards are processed in parallel.
+		void merge(const ShardedPiece& piece);
+
+	///	writes the merged vector to 'av' and clears the shards.
+		void assemble(AlgebraicVector& av);
+
+	private:
+		int shard_of(const Node& n) const;
+
+		struct Shard{
+			AlgebraicVector	av;
+			MergeIndex		index;
+		///	key of each node and entry in the order in which they were first seen
+			std::vector<uint64_t>				nodeKeys;
+			std::vector<std::vector<uint64_t> >	entryKeys;
+		};
+
+		std::vector<Shard>		m_shards;
+		bool					m_addValues;
+		int						m_worldDim;
+
+	///	number of nodes and entries of all pieces merged so far
+		uint64_t				m_numNodeKeys;
+		std::vector<uint64_t>	m_numEntryKeys;
+
+	///	maps nodes of the current piece to nodes of their shard
+		std::vector<uint>		m_pieceToShard;
+};
+
+#endif	//__H__ugvec_sharded_merge
@@ -0,0 +1,180 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_text_parsing
+#define __H__ugvec_text_parsing
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+//	Helpers to parse text in place. All methods operate on [p, end) and don't
+//	require zero-terminated input.
+
+inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline const char* SkipSpaces(const char* p, const char* end)
+{
+	while(p < end && IsSpace(*p))
+		++p;
+	return p;
+}
+
+///	returns the position behind the next '\n' (or end)
+inline const char* SkipLine(const char* p, const char* end)
+{
+	const char* nl = (const char*)memchr(p, '\n', end - p);
+	return nl ? nl + 1 : end;
+}
+
+///	returns the position of the next '\n' (or end)
+inline const char* FindLineEnd(const char* p, const char* end)
+{
+	const char* nl = (const char*)memchr(p, '\n', end - p);
+	return nl ? nl : end;
+}
+
+
+///	parses a number with strtod. Used by ParseDouble if its fast path doesn't apply.
+inline const char* ParseDoubleSlow(const char* p, const char* end, double& valOut)
+{
+	char buf[128];
+	size_t len = 0;
+	while(p + len < end && len + 1 < sizeof(buf) && !IsSpace(p[len])){
+		buf[len] = p[len];
+		++len;
+	}
+	buf[len] = 0;
+
+	char* endPtr;
+	valOut = strtod(buf, &endPtr);
+	return p + (endPtr - buf);
+}
+
+
+///	parses a floating point number starting at p.
+/**	Returns the position behind the parsed number, or p if no number could
+ * be parsed. Numbers with at most 19 significant digits, a mantissa below 2^53
+ * and a decimal exponent in [-22, 22] are converted exactly without a call to
+ * strtod. All other numbers (including nan and inf) are passed to strtod.*/
+inline const char* ParseDouble(const char* p, const char* end, double& valOut)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const char* start = p;
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int numSigDigits = 0;
+	int numDigits = 0;
+	int exponent = 0;
+	bool truncated = false;
+
+	for(; p < end && IsDigit(*p); ++p, ++numDigits){
+		if(numSigDigits < 19){
+			mantissa = mantissa * 10 + (*p - '0');
+			if(mantissa != 0)
+				++numSigDigits;
+		}
+		else{
+			++exponent;
+			truncated |= (*p != '0');
+		}
+	}
+
+	if(p < end && *p == '.'){
+		++p;
+		for(; p < end && IsDigit(*p); ++p, ++numDigits){
+			if(numSigDigits < 19){
+				mantissa = mantissa * 10 + (*p - '0');
+				if(mantissa != 0)
+					++numSigDigits;
+				--exponent;
+			}
+			else
+				truncated |= (*p != '0');
+		}
+	}
+
+	if(numDigits == 0)
+		return ParseDoubleSlow(start, end, valOut);
+
+	if(p < end && (*p == 'e' || *p == 'E')){
+		const char* e = p + 1;
+		bool negExp = false;
+		if(e < end && (*e == '-' || *e == '+')){
+			negExp = (*e == '-');
+			++e;
+		}
+
+		if(e < end && IsDigit(*e)){
+			int expVal = 0;
+			for(; e < end && IsDigit(*e); ++e){
+				if(expVal < 100000)
+					expVal = expVal * 10 + (*e - '0');
+			}
+			exponent += negExp ? -expVal : expVal;
+			p = e;
+		}
+	}
+
+	if(mantissa == 0){
+		valOut = negative ? -0.0 : 0.0;
+		return p;
+	}
+
+	if(truncated || mantissa >= ((uint64_t)1 << 53) || exponent < -22 || exponent > 22)
+		return ParseDoubleSlow(start, end, valOut);
+
+	double val = (double)mantissa;
+	if(exponent < 0)
+		val /= pow10[-exponent];
+	else
+		val *= pow10[exponent];
+
+	valOut = negative ? -val : val;
+	return p;
+}
+
+
+///	parses an integer starting at p. Returns p if no integer could be parsed.
+inline const char* ParseInt(const char* p, const char* end, long& valOut)
+{
+	const char* start = p;
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		++p;
+	}
+
+	if(p == end || !IsDigit(*p))
+		return start;
+
+	long val = 0;
+	for(; p < end && IsDigit(*p); ++p)
+		val = val * 10 + (*p - '0');
+
+	valOut = negative ? -val : val;
+	return p;
+}
+
+#endif	//__H__ugvec_text_parsing
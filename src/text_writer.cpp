@@ -0,0 +1,162 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__has_include)
+	#if __has_include(<charconv>) && __cplusplus >= 201703L
+		#include <charconv>
+	#endif
+#endif
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <unistd.h>
+#else
+	#include <fcntl.h>
+	#include <io.h>
+	#include <sys/stat.h>
+#endif
+
+#include "parallel.h"
+#include "text_writer.h"
+
+using namespace std;
+
+char* FormatNumber(char* out, double val)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+//	shortest round-trip representation (Ryu based in common standard libraries)
+	return to_chars(out, out + 32, val).ptr;
+#else
+	for(int precision = 15; precision < 17; ++precision){
+		const int len = snprintf(out, 32, "%.*g", precision, val);
+		if(strtod(out, NULL) == val)
+			return out + len;
+	}
+	return out + snprintf(out, 32, "%.17g", val);
+#endif
+}
+
+
+OutputFile::
+OutputFile() :
+	m_fd(-1),
+	m_failed(false),
+	m_size(0)
+{
+}
+
+
+OutputFile::
+~OutputFile()
+{
+	close();
+}
+
+
+bool OutputFile::
+open(const char* filename)
+{
+	close();
+	m_failed = false;
+	m_size = 0;
+#ifndef _WIN32
+	m_fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#else
+	m_fd = _open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#endif
+	return m_fd >= 0;
+}
+
+
+bool OutputFile::
+close()
+{
+	if(m_fd >= 0){
+	#ifndef _WIN32
+		if(::close(m_fd) != 0)
+			m_failed = true;
+	#else
+		if(_close(m_fd) != 0)
+			m_failed = true;
+	#endif
+		m_fd = -1;
+	}
+	return !m_failed;
+}
+
+
+bool OutputFile::
+write(const char* data, size_t size)
+{
+	return write_at(m_size, data, size);
+}
+
+
+bool OutputFile::
+write_at(uint64_t offset, const char* data, size_t size)
+{
+	if(m_fd < 0)
+		return false;
+
+	m_size = max(m_size, offset + size);
+
+#ifdef _WIN32
+	if(_lseeki64(m_fd, (__int64)offset, SEEK_SET) < 0){
+		m_failed = true;
+		return false;
+	}
+#endif
+
+	while(size > 0){
+	#ifndef _WIN32
+		const ssize_t num = pwrite(m_fd, data, size, (off_t)offset);
+	#else
+		const int num = _write(m_fd, data, (unsigned int)min<size_t>(size, 1 << 30));
+	#endif
+		if(num <= 0){
+			m_failed = true;
+			return false;
+		}
+		data += num;
+		size -= (size_t)num;
+		offset += (uint64_t)num;
+	}
+	return true;
+}
+
+
+bool WriteChunks(OutputFile& out, size_t numChunks,
+				 const function<void (size_t, TextBuffer&)>& format)
+{
+	const int numThreads = NumThreads();
+	const size_t maxAhead = 2 * (size_t)numThreads;
+
+//	chunk i is formatted into buffers[i % maxAhead]. OrderedPipeline doesn't
+//	produce chunk i + maxAhead before chunk i was consumed.
+	vector<TextBuffer> buffers(maxAhead);
+	uint64_t offset = out.size();
+	bool success = true;
+
+	OrderedPipeline(numChunks, numThreads, maxAhead,
+		[&](size_t i){
+			TextBuffer& buf = buffers[i % maxAhead];
+			buf.clear();
+			format(i, buf);
+			return true;
+		},
+		[&](size_t i){
+			const TextBuffer& buf = buffers[i % maxAhead];
+			success = success && out.write_at(offset, buf.data(), buf.size());
+			offset += buf.size();
+		});
+
+	return success;
+}
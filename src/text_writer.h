@@ -0,0 +1,139 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_text_writer
+#define __H__ugvec_text_writer
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+///	writes the shortest representation of val which is parsed back to exactly val
+/**	'out' has to provide space for at least 32 characters. Returns the end of
+ * the written characters. Uses std::to_chars if available (C++17), otherwise
+ * the shortest of 15, 16 and 17 significant digits that round-trips.*/
+char* FormatNumber(char* out, double val);
+
+
+///	Growing character buffer into which text output is formatted
+/**	Output is formatted into TextBuffers and written to files in big blocks
+ * (see OutputFile), which is much faster than formatted stream output.*/
+class TextBuffer{
+	public:
+		TextBuffer() : m_size(0)	{}
+
+		void reserve(size_t size)		{if(size > m_buf.size()) m_buf.resize(size);}
+		void clear()					{m_size = 0;}
+		size_t size() const				{return m_size;}
+		const char* data() const		{return m_buf.empty() ? NULL : &m_buf.front();}
+
+		void append(char c)
+		{
+			*tail(1) = c;
+			++m_size;
+		}
+
+		void append(const char* str)	{append(str, strlen(str));}
+
+		void append(const char* str, size_t len)
+		{
+			memcpy(tail(len), str, len);
+			m_size += len;
+		}
+
+		void append_uint(uint64_t val)
+		{
+			char tmp[20];
+			char* p = tmp + sizeof(tmp);
+			do{
+				*--p = char('0' + val % 10);
+				val /= 10;
+			}while(val);
+			append(p, tmp + sizeof(tmp) - p);
+		}
+
+		void append_int(int64_t val)
+		{
+			if(val < 0){
+				append('-');
+				append_uint(uint64_t(0) - (uint64_t)val);
+			}
+			else
+				append_uint((uint64_t)val);
+		}
+
+	///	appends val in its shortest round-trip representation (see FormatNumber)
+		void append_number(double val)
+		{
+			char* p = tail(32);
+			m_size = FormatNumber(p, val) - data();
+		}
+
+	private:
+	///	makes sure that 'num' characters can be appended and returns the current end
+		char* tail(size_t num)
+		{
+			if(m_size + num > m_buf.size())
+				m_buf.resize(std::max<size_t>(2 * m_buf.size(), m_size + num + 256));
+			return &m_buf.front() + m_size;
+		}
+
+		std::vector<char>	m_buf;
+		size_t				m_size;
+};
+
+
+///	File to which text or binary output is written in big blocks
+/**	All writes are positioned writes (pwrite on POSIX systems). 'write'
+ * appends behind the data which was written so far.*/
+class OutputFile{
+	public:
+		OutputFile();
+		~OutputFile();
+
+	///	creates or truncates the file. Returns false on failure.
+		bool open(const char* filename);
+
+	///	closes the file. Returns false if any write failed.
+		bool close();
+
+		bool is_open() const	{return m_fd >= 0;}
+
+	///	appends the given bytes. Returns false on failure.
+		bool write(const char* data, size_t size);
+		bool write(const TextBuffer& buf)	{return write(buf.data(), buf.size());}
+
+	///	writes the given bytes at the given offset. Returns false on failure.
+		bool write_at(uint64_t offset, const char* data, size_t size);
+
+	///	number of bytes up to the end of the last write
+		uint64_t size() const	{return m_size;}
+
+	private:
+		OutputFile(const OutputFile&);
+		OutputFile& operator = (const OutputFile&);
+
+		int			m_fd;
+		bool		m_failed;
+		uint64_t	m_size;
+};
+
+
+///	formats numChunks chunks of text concurrently and appends them to 'out' in order
+/**	format(i, buf) has to append the text of chunk i to the empty buffer buf.
+ * Chunks are formatted by NumThreads() threads (see parallel.h) into
+ * separate buffers. The calling thread writes the finished chunks in order
+ * through positioned writes. Only a few buffers per thread exist at a time.
+ * Returns false if a write failed.*/
+bool WriteChunks(OutputFile& out, size_t numChunks,
+				 const std::function<void (size_t, TextBuffer&)>& format);
+
+#endif	//__H__ugvec_text_writer
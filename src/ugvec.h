@@ -0,0 +1,53 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_ugvec
+#define __H__ugvec_ugvec
+
+///	public interface of the ugvec library (libugvec)
+/**	This header declares everything which is required to load, compare and
+ * analyse vectors in-process:
+ *
+ * - AlgebraicVector and its operations (algebraic_vector.h)
+ * - ViewArrays, which makes an AlgebraicVector reference caller-owned
+ *   coordinates and values without copying them (algebraic_vector.h)
+ * - LoadVector, SaveVector and the format specific loaders (file_io.h)
+ * - statistics, norms and histograms (vec_tools.h)
+ * - ComputeDifferenceStatistics, which compares two vectors without
+ *   modifying or copying them (vec_tools.h)
+ * - SetNumThreads (parallel.h)
+ *
+ * Errors are reported like in the ugvec executable: loaders return false
+ * and print a message, violated preconditions throw UGVecError.
+ *
+ * Example: comparing the solution of a simulation against a reference file
+ * at every time step. 'values' points to arrays which the simulation updates
+ * in place, so the view and the index are only created once.
+ *
+ *	AlgebraicVector ref, sol;
+ *	LoadVector(ref, "reference.vec", true);
+ *	ViewArrays(sol, 3, coords, numNodes, values, numComps);
+ *	DifferenceIndex index;
+ *	index.init(sol, ref);
+ *
+ *	// at each time step
+ *	std::vector<ComponentStatistics> stats;
+ *	std::vector<ComponentNorms> norms;
+ *	ComputeDifferenceStatistics(stats, sol, ref, &index);
+ *	ComputeNorms(norms, stats);
+ *
+ * UGVEC_API_VERSION is incremented whenever a declaration of this interface
+ * changes incompatibly.*/
+#define UGVEC_API_VERSION	1
+
+#include "algebraic_vector.h"
+#include "file_io.h"
+#include "parallel.h"
+#include "vec_tools.h"
+
+#endif	//__H__ugvec_ugvec
@@ -9,12 +9,19 @@
 #ifndef __H__ugvec_base
 #define __H__ugvec_base
 
-typedef double	number;
-typedef unsigned int uint;
+//	This header is internal to ugvec and must not be included by the
+//	installed headers (see ugvec.h), since its names may collide with
+//	names of client code.
 
-class CommonError{};
-#define CHECK(expr, msg) 	{if(!(expr)) {cout << "ERROR: " << msg << endl; throw CommonError();}}
+#include <iostream>
+#include <sstream>
+#include "ugvec_types.h"
 
-#endif	//__H__ugvec_base
+typedef unsigned int uint;
 
+///	writes msg to cout in a single write, so that lines of different threads don't mix
+#define LOG(msg)			{std::ostringstream logSS; logSS << msg; std::cout << logSS.str() << std::flush;}
 
+#define CHECK(expr, msg) 	{if(!(expr)) {LOG("ERROR: " << msg << std::endl); throw UGVecError();}}
+
+#endif	//__H__ugvec_base
@@ -20,12 +20,24 @@
 #include <map>
 
 #include "algebraic_vector.h"
+#include "batch.h"
 #include "file_io.h"
+#include "parallel.h"
+#include "series.h"
+#include "serve.h"
+#include "ugvec_base.h"
 #include "vec_tools.h"
 
 
 using namespace std;
 
+///	returns true if the file has the extension of serial vec files
+static bool IsVecFile(const char* filename)
+{
+	string name = filename;
+	return name.rfind(".vec") != string::npos && name.rfind(".pvec") == string::npos;
+}
+
 
 int main(int argc, char** argv)
 {
@@ -37,6 +49,15 @@ int main(int argc, char** argv)
 	bool	histoAbs		= false;
 	bool	histoLog		= false;
 	bool	verbose			= false;
+	bool	streamDif		= false;
+	bool	canonical		= false;
+	bool	verifyFiles		= false;
+	int		numThreads		= 1;
+	number	tolerance		= 0;
+	int		numNeighbours	= 1;
+	bool	printNorms		= false;
+	int		firstStep		= 0;
+	int		lastStep		= -1;
 
 	static const int maxNumFiles = 3;
 	const char* file[maxNumFiles];
@@ -81,10 +102,73 @@ int main(int argc, char** argv)
 				histoAbs = true;
 			}
 
+			else if(strcmp(argv[i], "-threads") == 0){
+				if(i + 1 < argc){
+					numThreads = atoi(argv[i+1]);
+					++i;
+				}
+				else{
+					cout << "Invalid use of '-threads': An integer value has to be supplied." << endl;
+					return 1;
+				}
+			}
+
+			else if(strcmp(argv[i], "-tol") == 0){
+				if(i + 1 < argc){
+					tolerance = atof(argv[i+1]);
+					++i;
+				}
+				else{
+					cout << "Invalid use of '-tol': A number has to be supplied." << endl;
+					return 1;
+				}
+			}
+
+			else if(strcmp(argv[i], "-idw") == 0){
+				if(i + 1 < argc){
+					numNeighbours = atoi(argv[i+1]);
+					++i;
+				}
+				else{
+					cout << "Invalid use of '-idw': An integer value has to be supplied." << endl;
+					return 1;
+				}
+			}
+
+			else if(strcmp(argv[i], "-first") == 0 || strcmp(argv[i], "-last") == 0){
+				if(i + 1 < argc){
+					if(argv[i][1] == 'f')
+						firstStep = atoi(argv[i+1]);
+					else
+						lastStep = atoi(argv[i+1]);
+					++i;
+				}
+				else{
+					cout << "Invalid use of '" << argv[i] << "': An integer value has to be supplied." << endl;
+					return 1;
+				}
+			}
+
+			else if(strcmp(argv[i], "-norms") == 0){
+				printNorms = true;
+			}
+
 			else if(strcmp(argv[i], "-verbose") == 0){
 				verbose = true;
 			}
 
+			else if(strcmp(argv[i], "-stream") == 0){
+				streamDif = true;
+			}
+
+			else if(strcmp(argv[i], "-canonical") == 0){
+				canonical = true;
+			}
+
+			else if(strcmp(argv[i], "-verify") == 0){
+				verifyFiles = true;
+			}
+
 			else{
 				cout << "Invalid option supplied: " << argv[i] << endl;
 				return 1;
@@ -106,23 +190,49 @@ int main(int argc, char** argv)
 	if(argc > 1)
 		command = argv[1];
 
+	SetNumThreads(numThreads);
+	SetMatchTolerance(tolerance);
+	SetVerifyFiles(verifyFiles);
+
 
 	try{
 		if(command.find("process") == 0){
 			CHECK(numFiles == 2, "An in-file and an out-file have to be specified");
 			AlgebraicVector av;
 			LoadVector(av, file[0], makeCons, component);
+			if(canonical)
+				av.sort_canonical();
 			if(verbose){
 				cout << "vector properties:\n";
 				PrintInfo(av);
 			}
-			Save_VEC(av, file[1]);
+			SaveVector(av, file[1]);
 		}
 		else if(command.find("dif") == 0){
 			CHECK(numFiles == 3, "Two in-files and an out-file have to be specified");
+
+			if(streamDif){
+				if(component >= 0 || verbose || tolerance > 0 || printNorms || canonical
+				   || !IsVecFile(file[0]) || !IsVecFile(file[1])
+				   || string(file[2]).rfind(".ugvb") != string::npos)
+				{
+					cout << "INFO -- streaming dif requires two .vec in-files, a .vec out-file"
+						 " and no -component, -verbose, -tol, -norms or -canonical option. Using regular dif." << endl;
+				}
+				else if(StreamingDif_VEC(file[0], file[1], file[2]))
+					return 0;
+				else{
+					cout << "INFO -- in-files can't be processed by the streaming dif. Using regular dif." << endl;
+				}
+			}
+
 			AlgebraicVector av1, av2;
 			LoadVector(av1, file[0], makeCons, component);
 			LoadVector(av2, file[1], makeCons, component);
+			if(canonical){
+				av1.sort_canonical();
+				av2.sort_canonical();
+			}
 			
 			if(verbose){
 				cout << "Properties of v1:\n";
@@ -131,41 +241,137 @@ int main(int argc, char** argv)
 				PrintInfo(av1);
 			}
 			
+			vector<ComponentNorms> refNorms;
+			if(printNorms)
+				ComputeNorms(refNorms, av1);
+
 			av1.subtract_vector(av2);
 
+			vector<ComponentStatistics> stats;
+			ComputeStatistics(stats, av1);
+
 			if(verbose){
 				cout << "Properties of v1-v2:\n";
+				PrintInfo(av1, &stats);
+			}
+
+			SaveVector(av1, file[2]);
+			PrintMinMax(av1, &stats);
+
+			if(printNorms){
+				vector<ComponentNorms> norms;
+				ComputeNorms(norms, stats);
+				cout << "Norms of v1-v2 (relative to v1):" << endl;
+				PrintNorms(norms, &refNorms);
+			}
+		}
+		else if(command.find("norms") == 0){
+			CHECK(numFiles == 1 || numFiles == 2, "One or two in-files have to be specified");
+			AlgebraicVector av;
+			LoadVector(av, file[0], makeCons, component);
+
+			vector<ComponentNorms> norms;
+			ComputeNorms(norms, av);
+
+			if(numFiles == 2){
+				AlgebraicVector av2;
+				LoadVector(av2, file[1], makeCons, component);
+				if(canonical){
+					av.sort_canonical();
+					av2.sort_canonical();
+				}
+
+				vector<ComponentNorms> refNorms;
+				refNorms.swap(norms);
+				av.subtract_vector(av2);
+				ComputeNorms(norms, av);
+				cout << "Norms of v1-v2 (relative to v1):" << endl;
+				PrintNorms(norms, &refNorms);
+			}
+			else
+				PrintNorms(norms);
+		}
+		else if(command.find("compare-nn") == 0){
+			CHECK(numFiles == 3, "Two in-files and an out-file have to be specified");
+			AlgebraicVector av1, av2;
+			LoadVector(av1, file[0], makeCons, component);
+			LoadVector(av2, file[1], makeCons, component);
+
+			if(verbose){
+				cout << "Properties of v1:\n";
 				PrintInfo(av1);
+				cout << "Properties of v2:\n";
+				PrintInfo(av2);
 			}
 
-			Save_VEC(av1, file[2]);
-			PrintMinMax(av1);
+			AlgebraicVector difVec;
+			CHECK(InterpolatedDifference(difVec, av1, av2, numNeighbours),
+				  "Vectors can't be compared.");
+
+			vector<ComponentStatistics> stats;
+			ComputeStatistics(stats, difVec);
+
+			SaveVector(difVec, file[2]);
+			PrintMinMax(difVec, &stats);
 		}
 		else if(command.find("minmax") == 0){
 			CHECK(numFiles == 1, "An in-file has to be specified.");
 			AlgebraicVector av;
 			LoadVector(av, file[0], makeCons, component);
+			if(canonical)
+				av.sort_canonical();
+
+			vector<ComponentStatistics> stats;
+			ComputeStatistics(stats, av);
 			if(verbose){
 				cout << "vector properties:\n";
-				PrintInfo(av);
+				PrintInfo(av, &stats);
 			}
-			PrintMinMax(av);
+			PrintMinMax(av, &stats);
 		}
 		else if(command.find("histogram") == 0){
 			CHECK(numFiles == 2, "An in-file and an out-file have to be specified");
 			AlgebraicVector av;
 			LoadVector(av, file[0], makeCons, component);
+			if(canonical)
+				av.sort_canonical();
+
+			vector<ComponentStatistics> stats;
+			ComputeStatistics(stats, av);
 			if(verbose){
 				cout << "vector properties:\n";
-				PrintInfo(av);
+				PrintInfo(av, &stats);
+			}
+			SaveHistogramToUGX(av, file[1], histoSecs, histoAbs, histoLog, &stats);
+		}
+		else if(command.find("series") == 0){
+			CHECK(numFiles == 2 || numFiles == 3, "Two file patterns have to be specified");
+			if(!RunSeries(file[0], file[1], numFiles == 3 ? file[2] : NULL,
+						  firstStep, lastStep, makeCons, component, canonical))
+			{
+				return 1;
 			}
-			SaveHistogramToUGX(av, file[1], histoSecs, histoAbs, histoLog);
+		}
+		else if(command.find("serve") == 0){
+			CHECK(numFiles == 1, "A socket path has to be specified");
+			if(!RunServer(file[0], canonical))
+				return 1;
+		}
+		else if(command.find("batch") == 0){
+			CHECK(numFiles == 1, "A script file has to be specified");
+			if(!RunBatch(file[0], canonical))
+				return 1;
 		}
 		else if(command.find("info") == 0){
 			CHECK(numFiles == 1, "An in-file has to be specified");
 			AlgebraicVector av;
 			LoadVector(av, file[0], makeCons, component);
-			PrintInfo(av);
+			if(canonical)
+				av.sort_canonical();
+
+			vector<ComponentStatistics> stats;
+			ComputeStatistics(stats, av);
+			PrintInfo(av, &stats);
 		}
 		else{
 			cout << "ugvec - (c) 2013-2017 Sebastian Reiter, G-CSC Frankfurt" << endl;
@@ -183,11 +389,27 @@ int main(int argc, char** argv)
 			cout << "             consistent storage type, please specify the option '-consistent'." << endl;
 			cout << "             If a component is specified through the '-component' option, only the specified" << endl;
 			cout << "             component will be written to the resulting file." << endl;
+			cout << "             If the out-file has the extension '.ugvb', it is written in a binary format" << endl;
+			cout << "             which can be loaded much faster than '.vec' files." << endl;
 			cout << "             2 Files required - 1: in-file, 2: out-file" << endl << endl;
 
   			cout << "  dif:       Subtracts the second vector from the first and writes the result to a file." << endl;
   			cout << "             Parallel input vectors are assumed to be in additive storage unless" << endl;
   			cout << "             the option -consistent was specified" << endl;
+  			cout << "             With the option -stream, two .vec files are processed row by row without" << endl;
+  			cout << "             loading them. Only the distinct positions are kept in memory, up to" << endl;
+  			cout << "             about 4 million positions." << endl;
+  			cout << "             3 Files required - 1: in-file-1, 2: in-file-2, 3: out-file" << endl << endl;
+
+  			cout << "  norms:     Prints the L1, L2 and Linf norm of each component of a vector. If two" << endl;
+  			cout << "             in-files are specified, the norms of their difference and the norms relative" << endl;
+  			cout << "             to the first vector are printed." << endl;
+  			cout << "             1 or 2 Files required - 1: in-file-1, 2: in-file-2 (optional)" << endl << endl;
+
+  			cout << "  compare-nn: Subtracts the second vector from the first, where the two vectors may be" << endl;
+  			cout << "             defined on different meshes. The second vector is evaluated at the positions" << endl;
+  			cout << "             of the first one through its nearest entry, or through inverse distance" << endl;
+  			cout << "             weighting of its n nearest entries if the option -idw n is specified." << endl;
   			cout << "             3 Files required - 1: in-file-1, 2: in-file-2, 3: out-file" << endl << endl;
 
   			cout << "  minmax:    Prints the minimal and maximal values of each component of a vector" << endl;
@@ -199,6 +421,34 @@ int main(int argc, char** argv)
 
 			cout << "  info:      Prints Information on the number of entries, components, etc." << endl << endl;
 
+			cout << "  batch:     Executes the commands of a script in one process. Each line holds one of" << endl;
+			cout << "                load name file [-consistent] [-component n]" << endl;
+			cout << "                dif name a b    (name = a - b)" << endl;
+			cout << "                norms a [b], minmax a, info a, save a file," << endl;
+			cout << "                histogram a file.ugx [-histoSecs n] [-histoAbs] [-histoLog]" << endl;
+			cout << "             Loaded vectors are cached, so each file is parsed only once, even if it is" << endl;
+			cout << "             loaded under several names." << endl;
+			cout << "             Independent commands are executed concurrently (see -threads)." << endl;
+			cout << "             1 File required - 1: script-file" << endl << endl;
+
+			cout << "  series:    Compares two series of vectors step by step and prints a table with one" << endl;
+			cout << "             row per step, holding min, max, L1, L2, Linf and the L2 norm relative to v1" << endl;
+			cout << "             of each component of v1-v2. The file patterns contain an integer conversion" << endl;
+			cout << "             like 'sol_%04d.vec', which is replaced by the step. If the second pattern has" << endl;
+			cout << "             none, each step is compared against the same vector. The next steps are" << endl;
+			cout << "             loaded while a step is compared. Steps start at -first and run until -last" << endl;
+			cout << "             or until a file is missing." << endl;
+			cout << "             2 or 3 Files required - 1: pattern-1, 2: pattern-2, 3: table-file (optional)" << endl << endl;
+
+			cout << "  serve:     Keeps loaded vectors in memory and answers requests on a Unix domain" << endl;
+			cout << "             socket. Each request is a line holding a command with its files and" << endl;
+			cout << "             options (process, dif, norms, compare-nn, minmax, histogram, info), e.g." << endl;
+			cout << "                echo 'minmax sol.pvec' | nc -U ugvec.sock" << endl;
+			cout << "             The output is followed by a line '== ok' or '== error'. A cached vector" << endl;
+			cout << "             is reloaded if its file changed. 'clear' empties the cache, 'quit' stops" << endl;
+			cout << "             the server. -threads, -tol, -canonical and -verify are set on the server." << endl;
+			cout << "             1 File required - 1: socket-path" << endl << endl;
+
 
 			cout << "OPTIONS:" << endl;
 
@@ -217,7 +467,38 @@ int main(int argc, char** argv)
 			cout << "  -histoLog:        If specified, histogram command will use sections on a logarithmic scale" << endl;
 			cout << "                    (this implies -histoAbs)." << endl << endl;
 
+			cout << "  -threads n:       Number of threads used e.g. to load the pieces of parallel vectors" << endl;
+			cout << "                    concurrently. If n is 0, all hardware threads are used. Default is 1." << endl << endl;
+
+			cout << "  -tol eps:         Positions whose distance is at most eps are treated as the same" << endl;
+			cout << "                    position when vectors or the pieces of parallel vectors are" << endl;
+			cout << "                    merged (e.g. by dif). Default is 0, i.e. coordinates have to" << endl;
+			cout << "                    match exactly." << endl << endl;
+
+			cout << "  -idw n:           compare-nn only: Interpolates through inverse distance weighting" << endl;
+			cout << "                    of the n nearest entries. Default is 1 (nearest neighbour)." << endl << endl;
+
+			cout << "  -norms:           dif only: Prints the norms of the difference and the norms relative to" << endl;
+			cout << "                    the first vector (see command 'norms')." << endl << endl;
+
+			cout << "  -first n:         series only: First step to compare. Default is 0." << endl << endl;
+
+			cout << "  -last n:          series only: Last step to compare. By default, steps are compared" << endl;
+			cout << "                    until a file is missing." << endl << endl;
+
 			cout << "  -verbose:         If specified, additional information is printed for each processed vector." << endl << endl;
+
+			cout << "  -canonical:       Sorts nodes in Z-order and entries by their nodes after loading." << endl;
+			cout << "                    Neighbouring nodes are then stored close to each other (e.g. in" << endl;
+			cout << "                    files written by 'process') and dif uses a linear merge." << endl << endl;
+
+			cout << "  -verify:          Verifies the checksum of the data of '.ugvb' in-files while loading." << endl;
+			cout << "                    Without it, only the header and the node indices are validated." << endl << endl;
+
+			cout << "  -stream:          dif only: Reads both .vec in-files row by row in lock-step and writes" << endl;
+			cout << "                    the result on the fly. Falls back to the regular dif if the files" << endl;
+			cout << "                    don't contain the same positions in the same order or if they" << endl;
+			cout << "                    contain more than about 4 million distinct positions." << endl << endl;
 		}
 	}
 	catch(...){
@@ -0,0 +1,21 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef __H__ugvec_types
+#define __H__ugvec_types
+
+//	This header is part of the public interface of libugvec (see ugvec.h).
+//	Macros and short type names used inside of ugvec are defined in
+//	ugvec_base.h, which is not installed.
+
+typedef double	number;
+
+///	thrown by functions of libugvec if a precondition is violated (see CHECK in ugvec_base.h)
+class UGVecError{};
+
+#endif	//__H__ugvec_types
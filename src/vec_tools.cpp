@@ -6,105 +6,630 @@
 // Public License v. 2.0. If a copy of the MPL was not distributed
 // with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <algorithm>
 #include <cmath>
-#include <fstream>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <stdint.h>
 
 #include "algebraic_vector.h"
+#include "kd_tree.h"
+#include "merge_index.h"
+#include "parallel.h"
+#include "reductions.h"
+#include "text_writer.h"
+#include "ugvec_base.h"
 #include "vec_tools.h"
 
 using namespace std;
 
-void PrintInfo(const AlgebraicVector& av)
+ComponentStatistics::
+ComponentStatistics() :
+	numEntries(0),
+	numNaN(0),
+	numInf(0),
+	minVal(numeric_limits<number>::max()),
+	maxVal(-numeric_limits<number>::max()),
+	minInd(0),
+	maxInd(0),
+	minAbs(numeric_limits<number>::max()),
+	maxAbs(-numeric_limits<number>::max()),
+	minPosAbs(numeric_limits<number>::max()),
+	sum(0)
 {
-	const int numComps = av.max_component_index() + 1;
+}
+
+
+///	computes the statistics of num values. Indices are relative to 'data'.
+static void
+ComputeBlockStatistics(ComponentStatistics& stats, const number* data, size_t num)
+{
+	stats = ComponentStatistics();
+	stats.numEntries = num;
+
+//	the norm sums are computed by the vectorized kernel. Since blocks are
+//	small, the second loop reads the data from the cache.
+	stats.normSums = ComputeNormSums(data, num);
+
+	number sum = 0, comp = 0;
+	for(size_t i = 0; i < num; ++i){
+		const number x = data[i];
+		if(x < stats.minVal){
+			stats.minVal = x;
+			stats.minInd = i;
+		}
+		if(x > stats.maxVal){
+			stats.maxVal = x;
+			stats.maxInd = i;
+		}
 
-	vector<size_t>	numEntriesPerComp(numComps, 0);
-	for(size_t i = 0; i < av.positions.size(); ++i){
-		const Position& p = av.positions[i];
-		++numEntriesPerComp[p.ci];
+		const number a = fabs(x);
+		stats.minAbs = min(stats.minAbs, a);
+		stats.maxAbs = max(stats.maxAbs, a);
+		if(a > 0)
+			stats.minPosAbs = min(stats.minPosAbs, a);
+
+		if(x != x){
+			++stats.numNaN;
+			continue;
+		}
+		if(a == numeric_limits<number>::infinity())
+			++stats.numInf;
+
+	//	the compensation is only kept while the sum is finite, since
+	//	(t - sum) - y would be nan for an infinite sum t
+		const number y = x - comp;
+		const number t = sum + y;
+		comp = (fabs(t) < numeric_limits<number>::infinity()) ? (t - sum) - y : 0;
+		sum = t;
 	}
+	stats.sum = sum - comp;
+}
 
-	cout << "Entries per component:" << endl;
-	for(int i = 0; i < numComps; ++i)
-		cout << "  [" << i << "]: " << numEntriesPerComp[i] << endl;
+
+///	combines the statistics of consecutive blocks in [begin, end) through pairwise summation
+static ComponentStatistics
+CombineStatistics(const ComponentStatistics* begin, const ComponentStatistics* end)
+{
+	const size_t num = end - begin;
+	if(num == 0)
+		return ComponentStatistics();
+	if(num == 1)
+		return *begin;
+
+	const ComponentStatistics* mid = begin + num / 2;
+	const ComponentStatistics s1 = CombineStatistics(begin, mid);
+	const ComponentStatistics s2 = CombineStatistics(mid, end);
+
+	ComponentStatistics s = s1;
+	s.numEntries += s2.numEntries;
+	s.numNaN += s2.numNaN;
+	s.numInf += s2.numInf;
+
+//	on ties, the entry of the first block is kept, as in a serial loop
+	if(s2.minVal < s.minVal){
+		s.minVal = s2.minVal;
+		s.minInd = s1.numEntries + s2.minInd;
+	}
+	if(s2.maxVal > s.maxVal){
+		s.maxVal = s2.maxVal;
+		s.maxInd = s1.numEntries + s2.maxInd;
+	}
+
+	s.minAbs = min(s.minAbs, s2.minAbs);
+	s.maxAbs = max(s.maxAbs, s2.maxAbs);
+	s.minPosAbs = min(s.minPosAbs, s2.minPosAbs);
+	s.sum += s2.sum;
+	const NormSums pair[2] = {s1.normSums, s2.normSums};
+	s.normSums = PairwiseSum(pair, pair + 2);
+	return s;
 }
 
 
-void PrintMinMax(const AlgebraicVector& av)
+void ComputeStatistics(vector<ComponentStatistics>& statsOut,
+					   const AlgebraicVector& av)
 {
-	if(av.data.empty())
-		return;
+	const size_t blockSize = 4096;
+
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const Component& comp = av.comps[ci];
+		CHECK(comp.nodes.size() == comp.data.size(),
+			  "There should be as many position as data entries in an AlgebraicVector!");
+	}
 
-	CHECK(av.positions.size() == av.data.size(),
-		  "There should be as many position as data entries in an AlgebraicVector!");
+//	blocks of all components are processed in one parallel loop
+	vector<size_t> firstBlock(av.comps.size() + 1, 0);
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const size_t num = av.comps[ci].data.size();
+		firstBlock[ci + 1] = firstBlock[ci] + (num + blockSize - 1) / blockSize;
+	}
 
-	const int numCIs = av.max_component_index() + 1;
+	vector<ComponentStatistics> blockStats(firstBlock.back());
+	ParallelFor(blockStats.size(), NumThreads(),
+		[&](size_t block){
+			const size_t ci = upper_bound(firstBlock.begin(), firstBlock.end(), block)
+							  - firstBlock.begin() - 1;
+			const Array<number>& data = av.comps[ci].data;
+			const size_t first = (block - firstBlock[ci]) * blockSize;
+			ComputeBlockStatistics(blockStats[block], data.data() + first,
+								   min(blockSize, data.size() - first));
+		});
+
+	statsOut.resize(av.comps.size());
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		statsOut[ci] = CombineStatistics(blockStats.data() + firstBlock[ci],
+										 blockStats.data() + firstBlock[ci + 1]);
+	}
+}
 
-	vector<number> mins(numCIs, numeric_limits<number>::max());
-	vector<number> maxs(numCIs, -numeric_limits<number>::max());
-	vector<Position> minPos(numCIs);
-	vector<Position> maxPos(numCIs);
 
-	for(size_t i = 0; i < av.positions.size(); ++i){
-		const int ci = av.positions[i].ci;
-		if(av.data[i] < mins[ci]){
-			mins[ci] = av.data[i];
-			minPos[ci] = av.positions[i];
-		}
+namespace{
+///	node array of 'v' followed by the nodes which a merge of 'ref' would append to it
+struct ExtendedNodeArray{
+	ExtendedNodeArray(const Array<Node>& nodes, const vector<Node>& newNodes) :
+		nodes(nodes), newNodes(newNodes)	{}
 
-		if(av.data[i] > maxs[ci]){
-			maxs[ci] = av.data[i];
-			maxPos[ci] = av.positions[i];
+	Node operator [] (size_t i) const
+	{
+		return i < nodes.size() ? nodes[i] : newNodes[i - nodes.size()];
+	}
+
+	const Array<Node>&		nodes;
+	const vector<Node>&		newNodes;
+};
+}//	end of anonymous namespace
+
+
+bool DifferenceIndex::
+init(const AlgebraicVector& v, const AlgebraicVector& ref)
+{
+	comps.clear();
+	refNodes.clear();
+	if(v.worldDim != 0 && v.worldDim != ref.worldDim){
+		LOG("ERROR -- Can't subtract vectors with different world dimensions!" << endl);
+		return false;
+	}
+
+//	nodes and entries of ref are matched like in AlgebraicVector::merge, but
+//	instead of inserting missing nodes and entries into v, only their number
+//	is recorded.
+	MergeIndex index;
+	index.init(v);
+
+	vector<Node> newNodes;
+	vector<uint> refToThis(ref.nodes.size());
+	index.reserve(v.nodes.size() + ref.nodes.size());
+	for(size_t i = 0; i < ref.nodes.size(); ++i){
+		const uint newInd = (uint)(v.nodes.size() + newNodes.size());
+		const uint ind = index.find_or_insert(ref.nodes[i], newInd,
+											  ExtendedNodeArray(v.nodes, newNodes));
+		if(ind == newInd)
+			newNodes.push_back(ref.nodes[i]);
+		refToThis[i] = ind;
+	}
+
+	refNodes.resize(ref.nodes.size());
+	for(size_t i = 0; i < ref.nodes.size(); ++i)
+		refNodes[i] = refToThis[i] < v.nodes.size() ? refToThis[i] : MergeIndex::INVALID;
+
+	const size_t numNodes = v.nodes.size() + newNodes.size();
+	comps.resize(max(v.comps.size(), ref.comps.size()));
+	index.entryMap.resize(comps.size());
+
+	for(size_t ci = 0; ci < comps.size(); ++ci){
+		ComponentIndex& c = comps[ci];
+		c.numEntries = ci < v.comps.size() ? v.comps[ci].nodes.size() : 0;
+		c.numRefEntries = ci < ref.comps.size() ? ref.comps[ci].nodes.size() : 0;
+
+		vector<uint>& entryMap = index.entryMap[ci];
+		entryMap.resize(numNodes, MergeIndex::INVALID);
+
+	//	the entry of v - ref which each entry of ref is added to
+		vector<uint> targets(c.numRefEntries);
+		vector<uint> numMatches(c.numEntries, 0);
+		for(size_t i = 0; i < c.numRefEntries; ++i){
+			const uint node = refToThis[ref.comps[ci].nodes[i]];
+			uint& entry = entryMap[node];
+			if(entry == MergeIndex::INVALID){
+				entry = (uint)numMatches.size();
+				numMatches.push_back(0);
+			}
+			targets[i] = entry;
+			++numMatches[entry];
 		}
+
+		c.refBegin.resize(numMatches.size() + 1);
+		c.refBegin[0] = 0;
+		for(size_t i = 0; i < numMatches.size(); ++i)
+			c.refBegin[i + 1] = c.refBegin[i] + numMatches[i];
+
+	//	entries of ref are listed in their order, which is the order in which
+	//	a merge adds them
+		c.refEntries.resize(c.numRefEntries);
+		vector<uint> fill(c.refBegin.begin(), c.refBegin.end() - 1);
+		for(size_t i = 0; i < c.numRefEntries; ++i)
+			c.refEntries[fill[targets[i]]++] = (uint)i;
+	}
+
+	return true;
+}
+
+
+bool DifferenceIndex::
+fits(const AlgebraicVector& v, const AlgebraicVector& ref) const
+{
+	if(comps.size() != max(v.comps.size(), ref.comps.size())
+	   || refNodes.size() != ref.nodes.size())
+	{
+		return false;
+	}
+
+	for(size_t ci = 0; ci < comps.size(); ++ci){
+		const size_t numEntries = ci < v.comps.size() ? v.comps[ci].data.size() : 0;
+		const size_t numRefEntries = ci < ref.comps.size() ? ref.comps[ci].data.size() : 0;
+		if(comps[ci].numEntries != numEntries || comps[ci].numRefEntries != numRefEntries)
+			return false;
+	}
+	return true;
+}
+
+
+Position DifferenceIndex::
+position(const AlgebraicVector& v, const AlgebraicVector& ref, int ci, size_t i) const
+{
+	const ComponentIndex& c = comps[ci];
+	if(i < c.numEntries)
+		return v.position(ci, i);
+
+//	entries which were appended by a merge use the node of v if there is one
+	const uint refNode = ref.comps[ci].nodes[c.refEntries[c.refBegin[i]]];
+	const uint node = refNodes[refNode];
+	if(node != MergeIndex::INVALID)
+		return Position(v.nodes[node], ci);
+	return Position(ref.nodes[refNode], ci);
+}
+
+
+bool ComputeDifferenceStatistics(vector<ComponentStatistics>& statsOut,
+								 const AlgebraicVector& v, const AlgebraicVector& ref,
+								 const DifferenceIndex* index)
+{
+	const size_t blockSize = 4096;
+
+	DifferenceIndex tmpIndex;
+	if(!index){
+		if(!tmpIndex.init(v, ref))
+			return false;
+		index = &tmpIndex;
+	}
+	else if(v.worldDim != 0 && v.worldDim != ref.worldDim){
+		LOG("ERROR -- Can't subtract vectors with different world dimensions!" << endl);
+		return false;
+	}
+
+	CHECK(index->fits(v, ref), "DifferenceIndex doesn't fit the compared vectors.");
+
+	const size_t numComps = index->comps.size();
+	vector<size_t> firstBlock(numComps + 1, 0);
+	for(size_t ci = 0; ci < numComps; ++ci){
+		const size_t num = index->comps[ci].refBegin.size() - 1;
+		firstBlock[ci + 1] = firstBlock[ci] + (num + blockSize - 1) / blockSize;
+	}
+
+	vector<ComponentStatistics> blockStats(firstBlock.back());
+	ParallelFor(blockStats.size(), NumThreads(),
+		[&](size_t block){
+			const size_t ci = upper_bound(firstBlock.begin(), firstBlock.end(), block)
+							  - firstBlock.begin() - 1;
+			const DifferenceIndex::ComponentIndex& c = index->comps[ci];
+			const number* vals = ci < v.comps.size() ? v.comps[ci].data.data() : NULL;
+			const number* refVals = ci < ref.comps.size() ? ref.comps[ci].data.data() : NULL;
+
+			const size_t first = (block - firstBlock[ci]) * blockSize;
+			const size_t num = min(blockSize, c.refBegin.size() - 1 - first);
+
+		//	computed like subtract_vector to get identical results (including the sign of 0)
+			number diff[blockSize];
+			for(size_t i = 0; i < num; ++i){
+				const size_t e = first + i;
+				uint r = c.refBegin[e];
+				number d;
+				if(e < c.numEntries)
+					d = -vals[e];
+				else
+					d = refVals[c.refEntries[r++]];
+				for(; r < c.refBegin[e + 1]; ++r)
+					d += refVals[c.refEntries[r]];
+				diff[i] = -d;
+			}
+
+			ComputeBlockStatistics(blockStats[block], diff, num);
+		});
+
+	statsOut.resize(numComps);
+	for(size_t ci = 0; ci < numComps; ++ci){
+		statsOut[ci] = CombineStatistics(blockStats.data() + firstBlock[ci],
+										 blockStats.data() + firstBlock[ci + 1]);
+	}
+	return true;
+}
+
+
+void PrintInfo(const AlgebraicVector& av, const vector<ComponentStatistics>* stats,
+			   ostream& logOut)
+{
+	const int numComps = av.num_components();
+
+	logOut << "Entries per component:" << endl;
+	for(int i = 0; i < numComps; ++i){
+		logOut << "  [" << i << "]: " << av.comps[i].data.size() << endl;
+		if(stats && (*stats)[i].numNaN > 0)
+			logOut << "       nan values: " << (*stats)[i].numNaN << endl;
+		if(stats && (*stats)[i].numInf > 0)
+			logOut << "       inf values: " << (*stats)[i].numInf << endl;
+	}
+}
+
+
+void PrintMinMax(const AlgebraicVector& av, const vector<ComponentStatistics>* stats,
+				 ostream& logOut)
+{
+	vector<ComponentStatistics> tmpStats;
+	if(!stats){
+		ComputeStatistics(tmpStats, av);
+		stats = &tmpStats;
+	}
+
+	for(int ci = 0; ci < av.num_components(); ++ci){
+		const ComponentStatistics& s = (*stats)[ci];
+		if(s.numEntries == 0)
+			continue;
+
+		PrintComponentMinMax(ci, s.minVal, av.position(ci, s.minInd),
+							 s.maxVal, av.position(ci, s.maxInd), logOut);
+	}
+}
+
+
+void PrintComponentMinMax(int ci, number minVal, const Position& minPos,
+						  number maxVal, const Position& maxPos, ostream& logOut)
+{
+	logOut << "Component " << ci << endl;
+	logOut << "  min: " << minVal << "\tat   " << minPos << endl;
+	logOut << "  max: " << maxVal << "\tat   " << maxPos << endl;
+}
+
+
+void ComputeNorms(vector<ComponentNorms>& normsOut, const AlgebraicVector& av)
+{
+	vector<ComponentStatistics> stats;
+	ComputeStatistics(stats, av);
+	ComputeNorms(normsOut, stats);
+}
+
+
+void ComputeNorms(vector<ComponentNorms>& normsOut,
+				  const vector<ComponentStatistics>& stats)
+{
+	normsOut.resize(stats.size());
+	for(size_t ci = 0; ci < stats.size(); ++ci){
+		const NormSums& s = stats[ci].normSums;
+		normsOut[ci].l1 = s.absSum;
+		normsOut[ci].l2 = sqrt(s.sqSum);
+		normsOut[ci].linf = s.maxAbs;
 	}
+}
+
 
-	for(int ci = 0; ci < numCIs; ++ci){
-		cout << "Component " << ci << endl;
-		cout << "  min: " << mins[ci] << "\tat   " << minPos[ci] << endl;
-		cout << "  max: " << maxs[ci] << "\tat   " << maxPos[ci] << endl;
+void PrintNorms(const vector<ComponentNorms>& norms,
+				const vector<ComponentNorms>* refNorms, ostream& logOut)
+{
+	for(size_t ci = 0; ci < norms.size(); ++ci){
+		const ComponentNorms& n = norms[ci];
+		logOut << "Component " << ci << endl;
+		if(refNorms && ci < refNorms->size()){
+			const ComponentNorms& r = (*refNorms)[ci];
+			logOut << "  L1:   " << n.l1 << "\trelative: " << n.l1 / r.l1 << endl;
+			logOut << "  L2:   " << n.l2 << "\trelative: " << n.l2 / r.l2 << endl;
+			logOut << "  Linf: " << n.linf << "\trelative: " << n.linf / r.linf << endl;
+		}
+		else{
+			logOut << "  L1:   " << n.l1 << endl;
+			logOut << "  L2:   " << n.l2 << endl;
+			logOut << "  Linf: " << n.linf << endl;
+		}
 	}
 }
 
 
 void ExtractComponent(AlgebraicVector& out, const AlgebraicVector& av, int ci)
 {
-	out.positions.clear();
-	out.data.clear();
+	out.clear();
 	out.worldDim = av.worldDim;
 
-	for(size_t i = 0; i < av.positions.size(); ++i){
-		if(av.positions[i].ci == ci){
-			out.positions.push_back(av.positions[i]);
-			out.positions.back().ci = 0;
-			out.data.push_back(av.data[i]);
-		}
+	if(ci < 0 || ci >= av.num_components())
+		return;
+
+	out.nodes = av.nodes;
+	out.comps.push_back(av.comps[ci]);
+}
+
+
+bool InterpolatedDifference(AlgebraicVector& out, const AlgebraicVector& av1,
+							const AlgebraicVector& av2, int numNeighbours,
+							ostream& logOut)
+{
+	CHECK(numNeighbours > 0, "Invalid number of neighbours provided: " << numNeighbours);
+
+	if(av1.worldDim != av2.worldDim && av2.num_entries() > 0){
+		logOut << "ERROR -- Can't compare vectors with different world dimensions!" << endl;
+		return false;
 	}
+
+	out.clear();
+	out.worldDim = av1.worldDim;
+	out.nodes = av1.nodes;
+	out.comps.resize(av1.comps.size());
+
+	const size_t k = (size_t)numNeighbours;
+	const size_t chunkSize = 4096;
+	const int numThreads = NumThreads();
+
+	for(size_t ci = 0; ci < av1.comps.size(); ++ci){
+		const Component& c1 = av1.comps[ci];
+		Component& oc = out.comps[ci];
+		oc.nodes = c1.nodes;
+		oc.data = c1.data;
+
+		if(ci >= av2.comps.size() || av2.comps[ci].data.empty())
+			continue;
+
+		const Component& c2 = av2.comps[ci];
+		vector<Node> points(c2.nodes.size());
+		for(size_t i = 0; i < points.size(); ++i)
+			points[i] = av2.nodes[c2.nodes[i]];
+
+		KDTree tree;
+		tree.build(points, av2.worldDim);
+		vector<Node>().swap(points);
+
+		const size_t numEntries = c1.data.size();
+		number* data = oc.data.data();
+
+		ParallelFor((numEntries + chunkSize - 1) / chunkSize, numThreads,
+			[&](size_t chunk){
+				vector<uint> inds(k);
+				vector<number> distSq(k);
+				const size_t last = min(numEntries, (chunk + 1) * chunkSize);
+				for(size_t i = chunk * chunkSize; i < last; ++i){
+					const size_t num = tree.find_nearest(av1.nodes[c1.nodes[i]], k,
+														 &inds.front(), &distSq.front());
+					number val;
+					if(num == 1 || distSq[0] == 0)
+						val = c2.data[inds[0]];
+					else{
+						number weightedSum = 0, weightSum = 0;
+						for(size_t j = 0; j < num; ++j){
+							const number w = 1. / distSq[j];
+							weightedSum += w * c2.data[inds[j]];
+							weightSum += w;
+						}
+						val = weightedSum / weightSum;
+					}
+					data[i] -= val;
+				}
+			});
+	}
+
+	return true;
 }
 
 	
+///	section of value x in a log scale histogram
+/**	Evaluates log for x. See LogSectionFromEdges for a faster alternative.*/
+static inline int
+LogSection(number x, int numSections, number logMin, number range)
+{
+	int section;
+	if (x == 0.0) section = 0;
+	else section = (int)((number)numSections * (log(fabs(x)) - logMin) / range);
+	if(section < 0) section = 0;
+	if(section >= numSections) section = numSections - 1;
+	return section;
+}
+
+
+///	computes the smallest absolute value of each section of a log scale histogram
+/**	edges[k] is the smallest number in [minPos, maxVal] for which LogSection
+ * returns a section >= k (k = 1, ..., numSections-1). edges[0] is 0.
+ * Since LogSection is monotonic, each edge is found by a binary search over
+ * the bit patterns of positive doubles, which have the same order as the
+ * values. This only costs about 64 log evaluations per section.*/
+static void
+ComputeLogSectionEdges(vector<number>& edges, int numSections, number minPos,
+					   number maxVal, number logMin, number range)
+{
+	edges.assign(numSections, 0);
+	uint64_t lo;
+	memcpy(&lo, &minPos, sizeof(lo));
+	uint64_t hiBits;
+	memcpy(&hiBits, &maxVal, sizeof(hiBits));
+
+	for(int k = 1; k < numSections; ++k){
+	//	find the first bit pattern in [lo, hiBits + 1) whose section is >= k
+		uint64_t hi = hiBits + 1;
+		while(lo < hi){
+			const uint64_t mid = lo + (hi - lo) / 2;
+			number val;
+			memcpy(&val, &mid, sizeof(val));
+			if(LogSection(val, numSections, logMin, range) >= k)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		number edge = numeric_limits<number>::infinity();
+		if(lo <= hiBits)
+			memcpy(&edge, &lo, sizeof(edge));
+		edges[k] = edge;
+	}
+}
+
+
+///	section of value x in a log scale histogram through the edges computed by ComputeLogSectionEdges
+/**	Returns the same section as LogSection without evaluating log for
+ * finite values.*/
+static inline int
+LogSectionFromEdges(number x, const vector<number>& edges, int numSections,
+					number logMin, number range)
+{
+	const number a = fabs(x);
+	if(!(a < numeric_limits<number>::infinity()))
+		return LogSection(x, numSections, logMin, range);
+
+//	branchless binary search for the last edge <= a
+	int section = 0;
+	int step = 1;
+	while(2 * step < numSections)
+		step *= 2;
+	for(; step > 0; step /= 2){
+		const int next = section + step;
+		section = (next < numSections && edges[next] <= a) ? next : section;
+	}
+	return section;
+}
+
+
 void CreateHistogram(vector<int>& histOut, const AlgebraicVector& av,
-					 int numSections, bool absoluteValues, bool logScale)
+					 int numSections, bool absoluteValues, bool logScale,
+					 const vector<ComponentStatistics>* stats, ostream& logOut)
 {
 	CHECK(numSections > 0, "Invalid number of sections provided: " << numSections);
 	CHECK(!logScale || absoluteValues, "Log scale histogram needs absolute values.")
 
+	vector<ComponentStatistics> tmpStats;
+	if(!stats){
+		ComputeStatistics(tmpStats, av);
+		stats = &tmpStats;
+	}
+
 	number minVal = numeric_limits<number>::max();
 	number maxVal = -numeric_limits<number>::max();
 	number minPosNonZeroVal = numeric_limits<number>::max();
 
-	if(absoluteValues){
-		for(size_t i = 0; i < av.data.size(); ++i){
-			minVal = min(minVal, fabs(av.data[i]));
-			maxVal = max(maxVal, fabs(av.data[i]));
-			if (fabs(av.data[i]) > 0.0) minPosNonZeroVal = min(minPosNonZeroVal, fabs(av.data[i]));
+	const size_t numEntries = av.num_entries();
+
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		const ComponentStatistics& s = (*stats)[ci];
+		if(absoluteValues){
+			minVal = min(minVal, s.minAbs);
+			maxVal = max(maxVal, s.maxAbs);
+			minPosNonZeroVal = min(minPosNonZeroVal, s.minPosAbs);
 		}
-	}
-	else{
-		for(size_t i = 0; i < av.data.size(); ++i){
-			minVal = min(minVal, av.data[i]);
-			maxVal = max(maxVal, av.data[i]);
+		else{
+			minVal = min(minVal, s.minVal);
+			maxVal = max(maxVal, s.maxVal);
 		}
 	}
 
@@ -121,116 +646,286 @@ void CreateHistogram(vector<int>& histOut, const AlgebraicVector& av,
 		range = maxVal - minVal;
 
 	if(range <= 0){
-		histOut.resize(av.data.size(), 0);
+		histOut.resize(numEntries, 0);
 		return;
 	}
 
-	histOut.resize(av.data.size());
-	vector<int> numEntriesPerSection(numSections, 0);
-
-	if(absoluteValues){
-		for(size_t i = 0; i < av.data.size(); ++i){
-			int section;
-			if (logScale)
-			{
-				if (av.data[i] == 0.0) section = 0;
-				else section = (int)((number)numSections * (log(fabs(av.data[i])) - log(minPosNonZeroVal)) / range);
+	histOut.resize(numEntries);
+
+	const number logMin = logScale ? log(minPosNonZeroVal) : 0;
+	vector<number> edges;
+	if(logScale && range < numeric_limits<number>::infinity())
+		ComputeLogSectionEdges(edges, numSections, minPosNonZeroVal, maxVal, logMin, range);
+
+//	entries are enumerated component by component. Ranges of entries are
+//	binned in parallel, each with its own section counters.
+	vector<size_t> compOffsets(av.comps.size() + 1, 0);
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		compOffsets[ci + 1] = compOffsets[ci] + av.comps[ci].data.size();
+
+	const size_t chunkSize = 1 << 16;
+	const size_t numChunks = (numEntries + chunkSize - 1) / chunkSize;
+	vector<vector<size_t> > chunkCounts(numChunks);
+
+	ParallelFor(numChunks, NumThreads(),
+		[&](size_t chunk){
+			vector<size_t>& counts = chunkCounts[chunk];
+			counts.resize(numSections, 0);
+			const size_t first = chunk * chunkSize;
+			const size_t last = min(first + chunkSize, numEntries);
+			size_t ci = upper_bound(compOffsets.begin(), compOffsets.end(), first)
+						- compOffsets.begin() - 1;
+			for(size_t entry = first; entry < last; ++ci){
+				const size_t compEnd = min(last, compOffsets[ci + 1]);
+				const number* data = av.comps[ci].data.data() + (entry - compOffsets[ci]);
+				int* sections = &histOut[entry];
+				const size_t num = compEnd - entry;
+
+				if(logScale){
+					if(edges.empty()){
+						for(size_t i = 0; i < num; ++i)
+							sections[i] = LogSection(data[i], numSections, logMin, range);
+					}
+					else{
+						for(size_t i = 0; i < num; ++i)
+							sections[i] = LogSectionFromEdges(data[i], edges, numSections,
+															  logMin, range);
+					}
+				}
+				else{
+				//	simple enough to be vectorized by the compiler
+					const number offset = minVal;
+					const number scale = (number)numSections;
+					for(size_t i = 0; i < num; ++i){
+						const number x = absoluteValues ? fabs(data[i]) : data[i];
+						int section = (int)(scale * (x - offset) / range);
+						section = max(section, 0);
+						section = min(section, numSections - 1);
+						sections[i] = section;
+					}
+				}
+
+				for(size_t i = 0; i < num; ++i)
+					++counts[sections[i]];
+				entry = compEnd;
 			}
-			else
-				section = (int)((number)numSections * (fabs(av.data[i]) - minVal) / range);
-			if(section < 0) section = 0;
-			if(section >= numSections) section = numSections - 1;
-			histOut[i] = section;
-			++numEntriesPerSection[section];
-		}
+		});
+
+	vector<size_t> numEntriesPerSection(numSections, 0);
+	for(size_t chunk = 0; chunk < numChunks; ++chunk){
+		for(int isec = 0; isec < numSections; ++isec)
+			numEntriesPerSection[isec] += chunkCounts[chunk][isec];
 	}
-	else{
-		for(size_t i = 0; i < av.data.size(); ++i){
-			int section = (int)((number)numSections * (av.data[i] - minVal) / range);
-			if(section < 0) section = 0;
-			if(section >= numSections) section = numSections - 1;
-			histOut[i] = section;
-			++numEntriesPerSection[section];
-		}
+
+	logOut << "Histogram Created:" << endl;
+	for(int isec = 0; isec < numSections; ++isec){
+		logOut << "section " << isec << ":\t";
+		if (logScale) logOut << (isec == 0 ? minVal : minPosNonZeroVal*exp((number)isec * range / (number)numSections));
+		else logOut << minVal + (number)isec * range / (number)numSections;
+		logOut << " - ";
+		if (logScale) logOut << minPosNonZeroVal * exp((number)(isec+1) * range / (number)numSections);
+		else logOut << minVal + (number)(isec+1) * range / (number)numSections;
+		logOut << ":\t" << numEntriesPerSection[isec] << " entries." << endl;
 	}
+}
+
+
+///	number of entries which are formatted together by one thread in SaveHistogramToUGX
+static const size_t histoChunkSize = 1 << 15;
+
 
-	cout << "Histogram Created:" << endl;
+///	sorts the indices of all entries by their section in hist (counting sort)
+/**	The entries of section s are written to sorted[sectionBegin[s]], ...,
+ * sorted[sectionBegin[s+1]-1] in ascending order. Chunks of entries are
+ * counted and scattered in parallel.*/
+static void
+SortEntriesBySection(vector<uint>& sorted, vector<size_t>& sectionBegin,
+					 const vector<int>& hist, int numSections)
+{
+	CHECK(hist.size() < (size_t)numeric_limits<uint>::max(),
+		  "Too many entries for a histogram.");
+
+	const size_t chunkSize = 1 << 16;
+	const size_t numChunks = (hist.size() + chunkSize - 1) / chunkSize;
+	const int numThreads = NumThreads();
+
+//	offsets[chunk][s] is first counts and then the target of the next entry
+	vector<vector<size_t> > offsets(numChunks);
+	ParallelFor(numChunks, numThreads,
+		[&](size_t chunk){
+			vector<size_t>& counts = offsets[chunk];
+			counts.resize(numSections, 0);
+			const size_t last = min(hist.size(), (chunk + 1) * chunkSize);
+			for(size_t i = chunk * chunkSize; i < last; ++i)
+				++counts[hist[i]];
+		});
+
+	sectionBegin.resize(numSections + 1);
+	size_t offset = 0;
 	for(int isec = 0; isec < numSections; ++isec){
-		cout << "section " << isec << ":\t";
-		if (logScale) cout << (isec == 0 ? minVal : minPosNonZeroVal*exp((number)isec * range / (number)numSections));
-		else cout << minVal + (number)isec * range / (number)numSections;
-		cout << " - ";
-		if (logScale) cout << minPosNonZeroVal * exp((number)(isec+1) * range / (number)numSections);
-		else cout << minVal + (number)(isec+1) * range / (number)numSections;
-		cout << ":\t" << numEntriesPerSection[isec] << " entries." << endl;
+		sectionBegin[isec] = offset;
+		for(size_t chunk = 0; chunk < numChunks; ++chunk){
+			const size_t count = offsets[chunk][isec];
+			offsets[chunk][isec] = offset;
+			offset += count;
+		}
 	}
+	sectionBegin[numSections] = offset;
+
+	sorted.resize(hist.size());
+	ParallelFor(numChunks, numThreads,
+		[&](size_t chunk){
+			vector<size_t>& next = offsets[chunk];
+			const size_t last = min(hist.size(), (chunk + 1) * chunkSize);
+			for(size_t i = chunk * chunkSize; i < last; ++i)
+				sorted[next[hist[i]]++] = (uint)i;
+		});
 }
 
 
 bool SaveHistogramToUGX(const AlgebraicVector& av, const char* filename,
-						int numSections, bool absoluteValues, bool logScale)
+						int numSections, bool absoluteValues, bool logScale,
+						const vector<ComponentStatistics>* stats, ostream& logOut)
 {
-	cout << "INFO -- saving histogram to " << filename << endl;
+	logOut << "INFO -- saving histogram to " << filename << endl;
 	
-	if(av.data.size() != av.positions.size()){
-		cout << "ERROR -- Invalid algebra vector - data and position size does not match."
-			 << " During write to " << filename << endl;
-		return false;
+	for(size_t ci = 0; ci < av.comps.size(); ++ci){
+		if(av.comps[ci].data.size() != av.comps[ci].nodes.size()){
+			logOut << "ERROR -- Invalid algebra vector - data and position size does not match."
+				 << " During write to " << filename << endl;
+			return false;
+		}
 	}
 	
-	ofstream out(filename);
-	if(!out){
-		cout << "ERROR -- File can not be opened for write: " << filename << endl;
+	if(av.worldDim < 1 || av.worldDim > 3){
+		logOut << "ERROR -- Unsupported world-dimension (" << av.worldDim
+			 << ") during write: " << filename << endl;
 		return false;
 	}
 
-	out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << endl;
-	out << "<grid name=\"defGrid\">" << endl;
-	out << "<vertices coords=\"" << av.worldDim << "\">";
-	
-	for(size_t i = 0; i < av.positions.size(); ++i){
-		switch(av.worldDim){
-			case 1:	out << av.positions[i].x; break;
-			case 2:	out << av.positions[i].x << " " << av.positions[i].y; break;
-			case 3:	out << av.positions[i].x << " " << av.positions[i].y << " " << av.positions[i].z; break;
-			default:
-				cout << "ERROR -- Unsupported world-dimension (" << av.worldDim
-					 << ") during write: " << filename << endl;
-				return false;
-		}
-
-		if(i + 1 < av.positions.size())
-			out << " ";
+	OutputFile out;
+	if(!out.open(filename)){
+		logOut << "ERROR -- File can not be opened for write: " << filename << endl;
+		return false;
 	}
 
-	out << "</vertices>" << endl;
+	TextBuffer buf;
+	buf.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+	buf.append("<grid name=\"defGrid\">\n");
+	buf.append("<vertices coords=\"");
+	buf.append_int(av.worldDim);
+	buf.append("\">");
+	out.write(buf);
+
+//	one vertex is written for each entry of each component. Chunks of
+//	entries are formatted concurrently.
+	vector<size_t> compOffsets(av.comps.size() + 1, 0);
+	for(size_t ci = 0; ci < av.comps.size(); ++ci)
+		compOffsets[ci + 1] = compOffsets[ci] + av.comps[ci].nodes.size();
+
+	const size_t numEntries = compOffsets.back();
+	const size_t numChunks = (numEntries + histoChunkSize - 1) / histoChunkSize;
+
+	bool success = WriteChunks(out, numChunks,
+		[&](size_t chunk, TextBuffer& chunkBuf){
+			const size_t first = chunk * histoChunkSize;
+			const size_t last = min(first + histoChunkSize, numEntries);
+			size_t ci = upper_bound(compOffsets.begin(), compOffsets.end(), first)
+						- compOffsets.begin() - 1;
+			for(size_t entry = first; entry < last; ++ci){
+				const Array<uint>& compNodes = av.comps[ci].nodes;
+				const size_t compEnd = min(last, compOffsets[ci + 1]);
+				for(size_t i = entry - compOffsets[ci]; entry < compEnd; ++i, ++entry){
+					const Node& n = av.nodes[compNodes[i]];
+					for(int d = 0; d < av.worldDim; ++d){
+						if(d > 0)
+							chunkBuf.append(' ');
+						chunkBuf.append_number(n.coord[d]);
+					}
+
+					if(entry + 1 < numEntries)
+						chunkBuf.append(' ');
+				}
+			}
+		});
+
+	buf.clear();
+	buf.append("</vertices>\n");
 
 	vector<int> hist;
-	CreateHistogram(hist, av, numSections, absoluteValues, logScale);
+	CreateHistogram(hist, av, numSections, absoluteValues, logScale, stats, logOut);
 	
-	out << "<subset_handler name=\"defSH\">" << endl;
+	buf.append("<subset_handler name=\"defSH\">\n");
+	success = out.write(buf) && success;
+	buf.clear();
+
+//	the entries of each section are contiguous after the counting sort. The
+//	sections are split into pieces which are formatted concurrently.
+	vector<uint> sorted;
+	vector<size_t> sectionBegin;
+	SortEntriesBySection(sorted, sectionBegin, hist, numSections);
+
+	struct Piece{
+		int		section;
+		size_t	begin;
+		size_t	end;
+	};
+
+	vector<Piece> pieces;
 	for(int isec = 0; isec < numSections; ++isec){
-		number ia = 0;
-		if(numSections > 1)
-			ia = (number)isec / (number)(numSections-1);
-		number r = max<number>(0, -1 + 2 * ia);
-		number g = 1. - fabs(2 * (ia - 0.5));
-		number b = max<number>(0, 1. - 2 * ia);
-
-		out << "<subset name=\"section " << isec
-			<< "\" color=\"" << r << " " << g << " " << b << " 1\">" << endl;
-
-		out << "<vertices>";
-		for(size_t i = 0; i < hist.size(); ++i){
-			if(hist[i] == isec){
-				out << " " << int(i);
+		size_t begin = sectionBegin[isec];
+		do{
+			Piece piece;
+			piece.section = isec;
+			piece.begin = begin;
+			piece.end = min(begin + histoChunkSize, sectionBegin[isec + 1]);
+			pieces.push_back(piece);
+			begin = piece.end;
+		}while(begin < sectionBegin[isec + 1]);
+	}
+
+	success = WriteChunks(out, pieces.size(),
+		[&](size_t ipiece, TextBuffer& chunkBuf){
+			const Piece& piece = pieces[ipiece];
+			const int isec = piece.section;
+			if(piece.begin == sectionBegin[isec]){
+				number ia = 0;
+				if(numSections > 1)
+					ia = (number)isec / (number)(numSections-1);
+				number r = max<number>(0, -1 + 2 * ia);
+				number g = 1. - fabs(2 * (ia - 0.5));
+				number b = max<number>(0, 1. - 2 * ia);
+
+				chunkBuf.append("<subset name=\"section ");
+				chunkBuf.append_int(isec);
+			//	colors are written with 6 significant digits like by an ostream
+				char color[64];
+				snprintf(color, sizeof(color), "%g %g %g", r, g, b);
+				chunkBuf.append("\" color=\"");
+				chunkBuf.append(color);
+				chunkBuf.append(" 1\">\n");
+				chunkBuf.append("<vertices>");
 			}
-		}
-		out << "</vertices>" << endl;
-		out << "</subset>" << endl;
+
+			for(size_t i = piece.begin; i < piece.end; ++i){
+				chunkBuf.append(' ');
+				chunkBuf.append_uint(sorted[i]);
+			}
+
+			if(piece.end == sectionBegin[isec + 1]){
+				chunkBuf.append("</vertices>\n");
+				chunkBuf.append("</subset>\n");
+			}
+		}) && success;
+
+	buf.append("</subset_handler>\n");
+	buf.append("</grid>\n");
+	out.write(buf);
+
+	if(!out.close() || !success){
+		logOut << "ERROR -- Writing to " << filename << " failed." << endl;
+		return false;
 	}
-	out << "</subset_handler>" << endl;
-	out << "</grid>" << endl;
 	
 	return true;
 }
@@ -9,21 +9,160 @@
 #ifndef __H__ugvec_vec_tools
 #define __H__ugvec_vec_tools
 
+#include <iostream>
 #include <vector>
+#include "reductions.h"
+#include "ugvec_types.h"
 
 struct AlgebraicVector;
+struct Position;
 
-void PrintInfo(const AlgebraicVector& av);
+//	Functions which print results write them to logOut, which allows to
+//	collect the output of concurrently executed commands (see RunBatch).
 
-void PrintMinMax(const AlgebraicVector& av);
+///	statistics of the values of a single component (see ComputeStatistics)
+/**	Apart from numNaN and normSums, nan values are ignored.*/
+struct ComponentStatistics{
+	ComponentStatistics();
+
+	size_t		numEntries;
+	size_t		numNaN;
+	size_t		numInf;		///< number of values which are +inf or -inf
+
+///	minimal and maximal value and their first entries. Start with max() and -max().
+	number		minVal, maxVal;
+	size_t		minInd, maxInd;
+
+///	minimal and maximal absolute value and the minimal non-zero absolute value (max() if there is none)
+	number		minAbs, maxAbs, minPosAbs;
+
+	number		sum;		///< sum of all values (compensated)
+	NormSums	normSums;
+};
+
+///	computes statistics of all components of av in a single pass over the data
+/**	This is the common base of PrintInfo, PrintMinMax, ComputeNorms and
+ * CreateHistogram, which all accept precomputed statistics, so that several
+ * of them can be called on a vector without rescanning it.
+ *
+ * Blocks of entries of all components are processed by NumThreads()
+ * threads (see parallel.h). The block results are combined in order, sums
+ * through pairwise summation. The result thus doesn't depend on the number
+ * of threads.*/
+void ComputeStatistics(std::vector<ComponentStatistics>& statsOut,
+					   const AlgebraicVector& av);
+
+///	prints the number of entries per component. If stats are given, counts of nan and inf values are printed, too.
+void PrintInfo(const AlgebraicVector& av,
+			   const std::vector<ComponentStatistics>* stats = NULL,
+			   std::ostream& logOut = std::cout);
+
+void PrintMinMax(const AlgebraicVector& av,
+				 const std::vector<ComponentStatistics>* stats = NULL,
+				 std::ostream& logOut = std::cout);
+
+///	prints the minimal and maximal value of component ci in the format of PrintMinMax
+void PrintComponentMinMax(int ci, number minVal, const Position& minPos,
+						  number maxVal, const Position& maxPos,
+						  std::ostream& logOut = std::cout);
+
+///	L1, L2 and Linf norm of a component
+struct ComponentNorms{
+	ComponentNorms() : l1(0), l2(0), linf(0)	{}
+	number l1;
+	number l2;
+	number linf;
+};
+
+///	computes the norms of all components of av (see ComputeStatistics)
+void ComputeNorms(std::vector<ComponentNorms>& normsOut, const AlgebraicVector& av);
+void ComputeNorms(std::vector<ComponentNorms>& normsOut,
+				  const std::vector<ComponentStatistics>& stats);
+
+///	prints the norms of each component.
+/**	If refNorms is specified, the norms relative to the norms of the
+ * associated components in refNorms are printed, too.*/
+void PrintNorms(const std::vector<ComponentNorms>& norms,
+				const std::vector<ComponentNorms>* refNorms = NULL,
+				std::ostream& logOut = std::cout);
+
+///	associates the entries of v - ref with the entries of v and ref
+/**	The entries of v - ref are enumerated like the entries of the result of
+ * subtract_vector: entries of v come first, followed by the entries of ref
+ * without a matching entry in v. For each entry, the index holds the
+ * matching entries of ref.
+ *
+ * The index only depends on the positions of v and ref (and on MatchTolerance()
+ * at the time of 'init'). It can thus be reused for vectors whose values
+ * change, e.g. for a view of the solution of a simulation at every time step
+ * (see ViewArrays).*/
+struct DifferenceIndex{
+///	matching entries of a single component
+	struct ComponentIndex{
+		ComponentIndex() : numEntries(0), numRefEntries(0)	{}
+		size_t				numEntries;		///< number of entries in the component of v
+		size_t				numRefEntries;	///< number of entries in the component of ref
+	///	the entries of ref which match entry i are refEntries[refBegin[i]], ..., refEntries[refBegin[i+1]-1]
+		std::vector<unsigned int>	refBegin;
+		std::vector<unsigned int>	refEntries;
+	};
+
+///	creates the index for v - ref. Returns false if the world dimensions differ.
+	bool init(const AlgebraicVector& v, const AlgebraicVector& ref);
+
+///	returns true if the number of nodes and entries of v and ref match the vectors passed to 'init'
+	bool fits(const AlgebraicVector& v, const AlgebraicVector& ref) const;
+
+///	returns the position of the i-th entry of component ci of v - ref
+	Position position(const AlgebraicVector& v, const AlgebraicVector& ref,
+					  int ci, size_t i) const;
+
+	std::vector<ComponentIndex>	comps;
+///	for each node of ref the matching node of v or INVALID (see MergeIndex)
+	std::vector<unsigned int>	refNodes;
+};
+
+///	computes the statistics of v - ref without modifying or copying v or ref
+/**	The values of v and ref are read in place and the differences are
+ * computed block by block, so views of caller-owned arrays (see ViewArrays)
+ * are never copied. The statistics equal the statistics of the result of
+ * v.subtract_vector(ref) if v and ref are not in canonical order (otherwise
+ * only minInd and maxInd may differ). minInd and maxInd refer to the
+ * entries of v - ref (see DifferenceIndex::position).
+ *
+ * If 'index' is NULL, a temporary index is created. Otherwise it has to be
+ * created for vectors with the same positions as v and ref.
+ * Returns false if the world dimensions of v and ref differ.*/
+bool ComputeDifferenceStatistics(std::vector<ComponentStatistics>& statsOut,
+								 const AlgebraicVector& v, const AlgebraicVector& ref,
+								 const DifferenceIndex* index = NULL);
 
 void ExtractComponent(AlgebraicVector& out, const AlgebraicVector& av, int ci);
 
+///	writes av1 - av2 to 'out', where av2 is interpolated at the positions of av1
+/**	For each component, a KDTree is built over the positions of the entries
+ * of that component in av2. The value of av2 at a position of av1 is the
+ * value of the nearest entry if numNeighbours == 1, otherwise the inverse
+ * distance weighted (1/d^2) mean of the numNeighbours nearest entries. If
+ * av2 has no entries in a component, its values are assumed to be 0.
+ * 'out' has the nodes and entries of av1. Trees are built and queried by
+ * NumThreads() threads (see parallel.h).
+ * Returns false and writes an error to logOut if the world dimensions of
+ * av1 and av2 differ.*/
+bool InterpolatedDifference(AlgebraicVector& out, const AlgebraicVector& av1,
+							const AlgebraicVector& av2, int numNeighbours,
+							std::ostream& logOut = std::cout);
+
+///	assigns a section to each entry. The bounds of the sections are taken from stats if specified.
 void CreateHistogram(std::vector<int>& histOut, const AlgebraicVector& av,
-					 int numSections, bool absoluteValues, bool logScale);
+					 int numSections, bool absoluteValues, bool logScale,
+					 const std::vector<ComponentStatistics>* stats = NULL,
+					 std::ostream& logOut = std::cout);
 
 bool SaveHistogramToUGX(const AlgebraicVector& av, const char* filename,
-						int numSections, bool absoluteValues, bool logScale);
+						int numSections, bool absoluteValues, bool logScale,
+						const std::vector<ComponentStatistics>* stats = NULL,
+						std::ostream& logOut = std::cout);
 
 
 #endif	//__H__ugvec_vec_tools
@@ -0,0 +1,212 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+//	base64_test decodes random and malformed base64 inputs with each vectorized
+//	code path supported by the CPU and with the scalar code of base64.cpp and
+//	checks that both produce the same bytes and the same decoded sizes. Valid encodings additionally have
+//	to decode to the original data. Returns 0 if all checks pass.
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base64.h"
+
+using namespace std;
+
+///	small deterministic generator, so that failures can be reproduced
+struct Random{
+	Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1)	{}
+
+	uint64_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	size_t uniform(size_t num)	{return (size_t)(next() % num);}
+
+	uint64_t state;
+};
+
+
+///	result of decoding an input with one of the code paths
+struct DecodeResult{
+	size_t					decodedSize;	///< result of base64_decoded_size
+	vector<unsigned char>	bytes;			///< output of Base64Decoder
+	bool					ok;				///< false if Base64Decoder didn't write decodedSize bytes
+};
+
+
+///	decodes 'in' through Base64Decoder in chunks of random size
+static DecodeResult
+Decode(const string& in, Base64SimdLevel level, uint64_t chunkSeed)
+{
+	base64_set_simd_level(level);
+
+	const unsigned char* src = (const unsigned char*)in.data();
+	DecodeResult res;
+	res.decodedSize = base64_decoded_size(src, in.size());
+	res.bytes.resize(res.decodedSize + 64);
+
+	Random rnd(chunkSeed);
+	Base64Decoder decoder(src, in.size());
+	size_t pos = 0;
+	while(true){
+		const size_t maxLen = min<size_t>(1 + rnd.uniform(100), res.bytes.size() - pos);
+		const size_t n = decoder.decode(res.bytes.data() + pos, maxLen);
+		pos += n;
+		if(n < maxLen || pos == res.bytes.size())
+			break;
+	}
+
+	res.ok = (pos == res.decodedSize);
+	res.bytes.resize(pos);
+	return res;
+}
+
+
+///	decodes 'in' with the vectorized code of the given level and the scalar code and compares the results
+static bool
+Check(const string& name, const string& in, const vector<unsigned char>* expected,
+	  Base64SimdLevel level, uint64_t chunkSeed)
+{
+	const DecodeResult simd = Decode(in, level, chunkSeed);
+	const DecodeResult scalar = Decode(in, BASE64_SIMD_NONE, chunkSeed);
+
+	bool success = true;
+	if(simd.decodedSize != scalar.decodedSize){
+		cout << "FAILED: " << name << ": decoded size " << simd.decodedSize
+			 << " (simd) != " << scalar.decodedSize << " (scalar)" << endl;
+		success = false;
+	}
+	if(simd.ok != scalar.ok){
+		cout << "FAILED: " << name << ": error status " << simd.ok
+			 << " (simd) != " << scalar.ok << " (scalar)" << endl;
+		success = false;
+	}
+	if(simd.bytes != scalar.bytes){
+		cout << "FAILED: " << name << ": decoded bytes differ" << endl;
+		success = false;
+	}
+	if(expected && (!scalar.ok || scalar.bytes != *expected)){
+		cout << "FAILED: " << name << ": wrong result for a valid encoding" << endl;
+		success = false;
+	}
+	return success;
+}
+
+
+static vector<unsigned char>
+RandomBytes(Random& rnd, size_t num)
+{
+	vector<unsigned char> bytes(num);
+	for(size_t i = 0; i < num; ++i)
+		bytes[i] = (unsigned char)rnd.next();
+	return bytes;
+}
+
+
+static string
+Encode(const vector<unsigned char>& bytes)
+{
+	return base64_encode(bytes.data(), bytes.size());
+}
+
+
+///	runs all checks for the vectorized code of the given level
+static void
+RunChecks(Base64SimdLevel level, int& numFailed, int& numChecks)
+{
+//	characters which may appear in malformed inputs
+	static const char noise[] = "=\n\r\t !#$%&*.:;?@[]^{}~-_\x80\xff";
+
+	Random rnd(42);
+
+	for(int iter = 0; iter < 2000; ++iter){
+		const size_t len = (iter < 200) ? iter : rnd.uniform(5000);
+		const vector<unsigned char> bytes = RandomBytes(rnd, len);
+		const string encoded = Encode(bytes);
+
+	//	valid encoding
+		numChecks++;
+		if(!Check("valid", encoded, &bytes, level, iter))
+			numFailed++;
+
+	//	concatenated encodings, as written for the header and the data of
+	//	a vtu DataArray
+		{
+			const vector<unsigned char> bytes2 = RandomBytes(rnd, rnd.uniform(300));
+			vector<unsigned char> all(bytes);
+			all.insert(all.end(), bytes2.begin(), bytes2.end());
+			numChecks++;
+			if(!Check("concatenated", encoded + Encode(bytes2), &all, level, iter))
+				numFailed++;
+		}
+
+	//	line breaks and indentation every few characters
+		{
+			string wrapped;
+			const size_t lineLen = 1 + rnd.uniform(80);
+			for(size_t i = 0; i < encoded.size(); i += lineLen)
+				wrapped += "\n\t  " + encoded.substr(i, lineLen);
+			numChecks++;
+			if(!Check("wrapped", wrapped, &bytes, level, iter))
+				numFailed++;
+		}
+
+	//	malformed: random noise, stray padding and truncation
+		{
+			string malformed = encoded;
+			const size_t numNoise = 1 + rnd.uniform(8);
+			for(size_t i = 0; i < numNoise; ++i){
+				const size_t pos = rnd.uniform(malformed.size() + 1);
+				malformed.insert(pos, 1, noise[rnd.uniform(sizeof(noise) - 1)]);
+			}
+			if(!malformed.empty() && rnd.uniform(2))
+				malformed.resize(rnd.uniform(malformed.size()));
+			numChecks++;
+			if(!Check("malformed", malformed, NULL, level, iter))
+				numFailed++;
+		}
+
+	//	arbitrary bytes
+		{
+			const vector<unsigned char> garbage = RandomBytes(rnd, rnd.uniform(500));
+			numChecks++;
+			if(!Check("garbage", string(garbage.begin(), garbage.end()), NULL, level, iter))
+				numFailed++;
+		}
+	}
+}
+
+
+int main()
+{
+	static const Base64SimdLevel levels[] = {BASE64_SIMD_SSE41, BASE64_SIMD_AVX2};
+	static const char* levelNames[] = {"sse4.1", "avx2"};
+
+	int numFailed = 0;
+	int numChecks = 0;
+	for(size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i){
+		if(base64_set_simd_level(levels[i]) != levels[i]){
+			cout << "base64 instruction set " << levelNames[i]
+				 << " isn't supported by the CPU. Skipped." << endl;
+			continue;
+		}
+		cout << "base64 instruction set: " << base64_simd_instruction_set() << endl;
+		RunChecks(levels[i], numFailed, numChecks);
+	}
+
+	cout << numChecks - numFailed << " of " << numChecks << " checks passed" << endl;
+	return numFailed == 0 ? 0 : 1;
+}
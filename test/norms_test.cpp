@@ -0,0 +1,131 @@
+// This file is part of ugvec, a program for analysing and comparing vectors
+//
+// Copyright (C) 2016,2017 Sebastian Reiter, G-CSC Frankfurt <sreiter@gcsc.uni-frankfurt.de>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+//	norms_test checks the norm sums of ComputeNormSums and the sums of
+//	ComputeStatistics for arrays containing infinite values, nan values and
+//	values whose squares overflow. Infinite values and overflows have to lead
+//	to infinite norms and sums, nan values to nan norms. Returns 0 if all
+//	checks pass.
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "algebraic_vector.h"
+#include "reductions.h"
+#include "vec_tools.h"
+
+using namespace std;
+
+static const number Inf = numeric_limits<number>::infinity();
+static const number NaN = numeric_limits<number>::quiet_NaN();
+
+static int numFailed = 0;
+static int numChecks = 0;
+
+
+///	compares two numbers, where nan equals nan
+static bool Same(number a, number b)
+{
+	return (a != a && b != b) || a == b;
+}
+
+
+static void Check(const string& name, const char* what, number val, number expected)
+{
+	numChecks++;
+	if(!Same(val, expected)){
+		cout << "FAILED: " << name << ": " << what << " is " << val
+			 << " instead of " << expected << endl;
+		numFailed++;
+	}
+}
+
+
+///	checks the NormSums of 'values' as a whole and split into two halves (see PairwiseSum)
+static void CheckNormSums(const string& name, const vector<number>& values,
+						  number absSum, number sqSum, number maxAbs)
+{
+	const NormSums s = ComputeNormSums(values.data(), values.size());
+	Check(name, "absSum", s.absSum, absSum);
+	Check(name, "sqSum", s.sqSum, sqSum);
+	Check(name, "maxAbs", s.maxAbs, maxAbs);
+
+	const size_t half = values.size() / 2;
+	const NormSums parts[2] = {ComputeNormSums(values.data(), half),
+							   ComputeNormSums(values.data() + half, values.size() - half)};
+	const NormSums p = PairwiseSum(parts, parts + 2);
+	Check(name + " (pairwise)", "absSum", p.absSum, absSum);
+	Check(name + " (pairwise)", "sqSum", p.sqSum, sqSum);
+	Check(name + " (pairwise)", "maxAbs", p.maxAbs, maxAbs);
+}
+
+
+///	checks ComponentStatistics::sum of a vector with a single component holding 'values'
+static void CheckStatisticsSum(const string& name, const vector<number>& values, number sum)
+{
+	AlgebraicVector av;
+	av.worldDim = 1;
+	av.comps.resize(1);
+	for(size_t i = 0; i < values.size(); ++i){
+		Node n;
+		n.x = (number)i;
+		av.comps[0].nodes.push_back(av.add_node(n));
+		av.comps[0].data.push_back(values[i]);
+	}
+
+	vector<ComponentStatistics> stats;
+	ComputeStatistics(stats, av);
+	Check(name + " (statistics)", "sum", stats.at(0).sum, sum);
+}
+
+
+int main()
+{
+	CheckNormSums("finite", {1, -2, 3, -4, 5}, 15, 55, 5);
+	CheckNormSums("inf", {1, Inf, 2, 3}, Inf, Inf, Inf);
+	CheckNormSums("-inf", {1, -Inf, 2, 3}, Inf, Inf, Inf);
+	CheckNormSums("overflow", {1e200, 1e200}, 2e200, Inf, 1e200);
+	CheckNormSums("sum overflow", {1e308, 1e308, 1e308, 1e308, 1e308}, Inf, Inf, 1e308);
+	CheckNormSums("nan", {1, NaN, 2, 3}, NaN, NaN, NaN);
+	CheckNormSums("nan and inf", {Inf, 1, NaN, 3}, NaN, NaN, NaN);
+
+//	nan values are ignored by ComponentStatistics::sum
+	CheckStatisticsSum("finite", {1, -2, 3, -4, 5}, 3);
+	CheckStatisticsSum("inf", {1, Inf, 2, 3}, Inf);
+	CheckStatisticsSum("-inf", {1, -Inf, 2, 3}, -Inf);
+	CheckStatisticsSum("inf - inf", {1, Inf, -Inf, 3}, NaN);
+	CheckStatisticsSum("overflow", {1e308, 1e308, 2}, Inf);
+	CheckStatisticsSum("nan", {1, NaN, 2}, 3);
+
+//	infinite and nan values at all positions of the vectorized loop and the
+//	remainder, followed by further values
+	for(size_t num = 1; num < 20; ++num){
+		for(size_t pos = 0; pos < num; ++pos){
+			vector<number> values(num, 1.5);
+			ostringstream name;
+			name << "position " << pos << " of " << num;
+
+			values[pos] = Inf;
+			CheckNormSums(name.str() + ": inf", values, Inf, Inf, Inf);
+
+			values[pos] = 1e300;
+			CheckNormSums(name.str() + ": overflow", values,
+						  1e300 + 1.5 * (num - 1), Inf, 1e300);
+
+			values[pos] = NaN;
+			CheckNormSums(name.str() + ": nan", values, NaN, NaN, NaN);
+		}
+	}
+
+	cout << numChecks - numFailed << " of " << numChecks << " checks passed" << endl;
+	return numFailed == 0 ? 0 : 1;
+}